@@ -0,0 +1,39 @@
+/*****************************************************************************
+ *
+ *    bits.h
+ *
+ *    Inline bit-field helpers for the hot paths of the um (instruction
+ *    decoding and program loading). They do what Bitpack_getu() and
+ *    Bitpack_newu() do for fields of 32-bit words, but can be inlined
+ *    and constant-folded since they live in a header.
+ *
+ *****************************************************************************/
+#ifndef BITS_H
+#define BITS_H
+
+#include <stdint.h>
+
+/*
+ * bits_getu()
+ * Parameters: a word; width (1 to 32) and lsb of a field, lsb + width <= 32
+ * Returns the unsigned value of the field
+ */
+static inline uint32_t bits_getu(uint32_t word, unsigned width, unsigned lsb)
+{
+    return (word >> lsb) & (uint32_t)(((uint64_t)1 << width) - 1);
+}
+
+/*
+ * bits_newu()
+ * Parameters: a word; width (1 to 32) and lsb of a field, lsb + width <= 32;
+ *             a value that fits in width bits
+ * Returns the word with the field replaced by value
+ */
+static inline uint32_t bits_newu(uint32_t word, unsigned width, unsigned lsb,
+                                 uint32_t value)
+{
+    uint32_t mask = (uint32_t)(((uint64_t)1 << width) - 1) << lsb;
+    return (word & ~mask) | ((value << lsb) & mask);
+}
+
+#endif
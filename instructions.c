@@ -13,6 +13,9 @@
 #include <stdlib.h>
 #include <inttypes.h>
 #include <math.h>
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
 
 #include "instructions.h"
 #include "seg_mem.h"
@@ -138,37 +141,117 @@ void unmap_segment(uint32_t regs[], seg_mem_obj *mem, reg c)
     seg_unmap(mem, regs[c]);
 }
 
+/*
+ * io_init()
+ * Parameters: pointer to a um_io; file descriptor to read input from;
+ *             FILE pointer to write output to
+ * Sets up the streams used by input() and output() with an empty buffer
+ * Returns nothing
+ */
+void io_init(um_io *io, int in_fd, FILE *out)
+{
+    assert(io != NULL && in_fd >= 0 && out != NULL);
+    io->in_fd  = in_fd;
+    io->out    = out;
+    io->in_pos = 0;
+    io->in_len = 0;
+}
+
+/*
+ * input_ready()
+ * Parameters: pointer to a um_io
+ * Checks (without blocking) whether a call to input() can complete right
+ * away, either from buffered bytes or because the descriptor is readable
+ * (end of input also counts as readable)
+ * Returns true if input() would not block, false otherwise
+ */
+bool input_ready(um_io *io)
+{
+    assert(io != NULL);
+    if (io->in_pos < io->in_len) {
+        return true;
+    }
+
+    struct pollfd pfd = { .fd = io->in_fd, .events = POLLIN, .revents = 0 };
+    int ready;
+    do {
+        ready = poll(&pfd, 1, 0);
+    } while (ready < 0 && errno == EINTR);
+    assert(ready >= 0);
+
+    return ready > 0;
+}
+
+/*
+ * input_wait()
+ * Parameters: pointer to a um_io
+ * Blocks until input_ready() would return true
+ * Returns nothing
+ */
+void input_wait(um_io *io)
+{
+    assert(io != NULL);
+    if (io->in_pos < io->in_len) {
+        return;
+    }
+
+    struct pollfd pfd = { .fd = io->in_fd, .events = POLLIN, .revents = 0 };
+    int ready;
+    do {
+        ready = poll(&pfd, 1, -1);
+    } while (ready < 0 && errno == EINTR);
+    assert(ready > 0);
+}
+
 /*
  * output()
- * Parameters: array of UM registers; index of register c
- * Prints contents of r[c] to stdout
+ * Parameters: array of UM registers; pointer to um I/O streams;
+ *             index of register c
+ * Prints contents of r[c] to the um's output stream
  * Unchecked runtime error for r[c] to be < 0 or > 255
  * Returns nothing
  */
-void output(uint32_t regs[], reg c)
+void output(uint32_t regs[], um_io *io, reg c)
 {
     assert(c < 8);
-    fputc(regs[c], stdout);
+    fputc(regs[c], io->out);
 }
 
 /*
  * input()
- * Parameters: array of UM registers; index of register c
+ * Parameters: array of UM registers; pointer to um I/O streams;
+ *             index of register c
  * Stores input in r[c]; if end of input signaled, stores all 1s in r[c]
- * CRE for input value to be < 0 or > 255
- * Returns nothing
+ * Refills the input buffer from the um's descriptor when it is empty,
+ * which blocks unless input_ready() said otherwise. A non-blocking
+ * descriptor can still come up empty if another reader of the same file
+ * took the input first; then r[c] is left alone.
+ * Returns true if r[c] was set, false if no input was available after all
  */
-void input(uint32_t regs[], reg c)
+bool input(uint32_t regs[], um_io *io, reg c)
 {
     assert(c < 8);
 
-    int input = getchar();
-    assert((input <= 255 && input >= 0) || input == EOF);
-    if (input != EOF) {
-        regs[c] = input;
+    if (io->in_pos == io->in_len) {
+        ssize_t nread;
+        do {
+            nread = read(io->in_fd, io->in_buf, IN_BUF_SIZE);
+        } while (nread < 0 && errno == EINTR);
+        if (nread < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            return false;
+        }
+        assert(nread >= 0);
+
+        io->in_pos = 0;
+        io->in_len = nread;
+    }
+
+    if (io->in_pos < io->in_len) {
+        regs[c] = io->in_buf[io->in_pos++];
     } else {
         regs[c] = ~0;
     }
+    return true;
 }
 
 /*
@@ -11,11 +11,30 @@
 #ifndef INSTRUCTIONS_H
 #define INSTRUCTIONS_H
 
+#include <stdio.h>
+#include <stdbool.h>
+#include <stddef.h>
 #include "assert.h"
 #include "seg_mem.h"
 
 typedef uint32_t reg;
 
+/* Size of the per-machine input buffer */
+#define IN_BUF_SIZE 4096
+
+/*
+ * I/O streams of a single um. Input is read from a raw file descriptor
+ * through a small buffer so that we can tell whether the next "in"
+ * instruction would block before executing it.
+ */
+typedef struct um_io {
+    int in_fd;
+    FILE *out;
+    size_t in_pos;
+    size_t in_len;
+    unsigned char in_buf[IN_BUF_SIZE];
+} um_io;
+
 /* Functions that update registers */
 void cond_mov        (uint32_t regs[], reg a, reg b, reg c);
 void addition        (uint32_t regs[], reg a, reg b, reg c);
@@ -25,8 +44,11 @@ void bitwise_nand    (uint32_t regs[], reg a, reg b, reg c);
 void load_value      (uint32_t regs[], reg a, uint32_t value);
 
 /* Functions for I/O */
-void output          (uint32_t regs[], reg c);
-void input           (uint32_t regs[], reg c);
+void io_init         (um_io *io, int in_fd, FILE *out);
+bool input_ready     (um_io *io);
+void input_wait      (um_io *io);
+void output          (uint32_t regs[], um_io *io, reg c);
+bool input           (uint32_t regs[], um_io *io, reg c);
 
 /* Functions that access and/or update memory */
 void segment_load    (uint32_t regs[], seg_mem_obj *mem, reg a, reg b, reg c);
@@ -0,0 +1,92 @@
+/*****************************************************************************
+ *
+ *    main.c
+ *
+ *    By:   Sitara Rao (srao03) and Arnav Kothari (akotha02)
+ *    Date: 11/20/2019
+ *      
+ *    Command line driver for the universal machine (um) program.
+ *    Reads the program file named on the command line and runs it with
+ *    the um module, using stdin and stdout for the um's I/O.
+ *
+ *    Usage: um [-c] [-H] [-t] program.um
+ *        -c  compress large segments that go unused for a while, and
+ *            print compression and peak memory statistics to stderr
+ *        -H  back the program and large segments with huge pages, and print
+ *            how many segments got them to stderr
+ *        -t  count dTLB and iTLB misses while the program runs, and
+ *            print the counts to stderr
+ *
+ *****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <unistd.h>
+
+#include "um.h"
+#include "seg_alloc.h"
+#include "tlb_perf.h"
+#include "assert.h"
+
+/* Settings for -c: segments of at least 256 KiB idle for 4 sweeps */
+static const uint32_t COLD_MIN_WORDS   = 1 << 16;
+static const uint32_t COLD_IDLE_SWEEPS = 4;
+
+/* Settings for -H: segments of at least one 2 MiB huge page */
+static const uint32_t HUGE_MIN_WORDS   = 1 << 19;
+
+/*
+ * main()
+ * Takes in the name of one um program file on the command line, optionally
+ * preceded by the options above.
+ * If filename is not provided or file does not exist it is a CRE.
+ * Calls functions to initialize, run, and free a um object.
+ * Returns 0. 
+ */
+int main(int argc, char* argv[])
+{
+    bool compress = false, huge = false, count_tlb = false;
+    int opt;
+    while ((opt = getopt(argc, argv, "cHt")) != -1) {
+        switch (opt) {
+            case 'c': compress  = true; break;
+            case 'H': huge      = true; break;
+            case 't': count_tlb = true; break;
+            default:  assert(false);
+        }
+    }
+    assert(optind == argc - 1);
+    FILE* fp = fopen(argv[optind], "r");
+    assert(fp != NULL);
+
+    /* Must come before any segment (including m[0]) is allocated */
+    if (huge) {
+        seg_alloc_huge(HUGE_MIN_WORDS);
+    }
+
+    um_obj *um = um_new(fp);
+    if (compress) {
+        seg_mem_compress_cold(um->memory, COLD_MIN_WORDS, COLD_IDLE_SWEEPS);
+    }
+
+    tlb_counters tlb;
+    if (count_tlb) {
+        tlb_start(&tlb);
+    }
+    um_run(um);
+    if (count_tlb) {
+        tlb_report(&tlb, stderr);
+    }
+
+    if (compress) {
+        seg_mem_report(um->memory, stderr);
+    }
+    if (huge) {
+        seg_alloc_report(stderr);
+    }
+    um_free(um);
+
+    fclose(fp);
+    return 0;
+}
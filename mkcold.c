@@ -0,0 +1,104 @@
+/*****************************************************************************
+ *
+ *    mkcold.c
+ *
+ *    Writes the um program behind the "um -c" numbers in the README to
+ *    stdout.
+ *
+ *    The program maps NBIG segments of BIG words one at a time and writes
+ *    one word in every page of each, so the segment is resident but still
+ *    almost all zeros. After each map it runs ITER load/store iterations
+ *    on a small segment, so the big segments go cold while the um keeps
+ *    accessing memory. At the end it loads one word from each of the
+ *    first "touched" big segments (bringing them back if they were
+ *    compressed), writes a newline and halts.
+ *
+ *    Usage: mkcold [touched] > cold.um
+ *
+ *****************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include <assert.h>
+
+#include "umasm.h"
+
+/* Shape of the benchmark run */
+static const uint32_t SMALL            = 64;
+static const uint32_t BIG              = 1 << 20;
+static const uint32_t PAGE_WORDS       = 1024;
+static const uint32_t NBIG             = 64;
+static const uint32_t ITER             = 1000000;
+static const uint32_t DEFAULT_TOUCHED  = 2;
+
+/* Label addresses in the program below */
+enum { MAP_LOOP = 5, FILL_LOOP = 8, FILL_EXIT = 17, INNER_LOOP = 18,
+       INNER_EXIT = 26, MAPS_EXIT = 32 };
+
+int main(int argc, char *argv[])
+{
+    assert(argc <= 2);
+    uint32_t touched = argc == 2 ? strtoul(argv[1], NULL, 10)
+                                 : DEFAULT_TOUCHED;
+    assert(touched <= NBIG);
+
+    /* r2 = small segment (id 1), r6 = -1, r3 = maps left */
+    emit(stdout, lv(7, SMALL));             /*  0 */
+    emit(stdout, op(ACTIVATE, 0, 2, 7));    /*  1 */
+    emit(stdout, lv(4, 0));                 /*  2 */
+    emit(stdout, op(NAND, 6, 4, 4));        /*  3 */
+    emit(stdout, lv(3, NBIG));              /*  4 */
+
+    /* MAP_LOOP: r7 = new big segment (ids 2 .. NBIG + 1), r1 = index */
+    emit(stdout, lv(7, BIG));               /*  5 */
+    emit(stdout, op(ACTIVATE, 0, 7, 7));    /*  6 */
+    emit(stdout, lv(1, BIG));               /*  7 */
+
+    /* FILL_LOOP: step r1 back one page and store -1 at m[r7][r1] */
+    emit(stdout, lv(4, PAGE_WORDS - 1));    /*  8 */
+    emit(stdout, op(NAND, 4, 4, 4));        /*  9 */
+    emit(stdout, op(ADD, 1, 1, 4));         /* 10 */
+    emit(stdout, op(SSTORE, 7, 1, 6));      /* 11 */
+
+    /* Jump to FILL_LOOP while r1 != 0, else to FILL_EXIT */
+    emit(stdout, lv(0, FILL_EXIT));         /* 12 */
+    emit(stdout, lv(4, FILL_LOOP));         /* 13 */
+    emit(stdout, op(CMOV, 0, 4, 1));        /* 14 */
+    emit(stdout, lv(5, 0));                 /* 15 */
+    emit(stdout, op(LOADP, 0, 5, 0));       /* 16 */
+
+    /* FILL_EXIT: r1 = counter for the small segment loop */
+    emit(stdout, lv(1, ITER));              /* 17 */
+
+    /* INNER_LOOP: store to and load from m[r2][0] (r5 is 0) */
+    emit(stdout, op(ADD, 1, 1, 6));         /* 18 */
+    emit(stdout, op(SSTORE, 2, 5, 1));      /* 19 */
+    emit(stdout, op(SLOAD, 4, 2, 5));       /* 20 */
+
+    /* Jump to INNER_LOOP while r1 != 0, else to INNER_EXIT */
+    emit(stdout, lv(0, INNER_EXIT));        /* 21 */
+    emit(stdout, lv(4, INNER_LOOP));        /* 22 */
+    emit(stdout, op(CMOV, 0, 4, 1));        /* 23 */
+    emit(stdout, lv(5, 0));                 /* 24 */
+    emit(stdout, op(LOADP, 0, 5, 0));       /* 25 */
+
+    /* INNER_EXIT: jump to MAP_LOOP while maps are left, else MAPS_EXIT */
+    emit(stdout, op(ADD, 3, 3, 6));         /* 26 */
+    emit(stdout, lv(0, MAPS_EXIT));         /* 27 */
+    emit(stdout, lv(4, MAP_LOOP));          /* 28 */
+    emit(stdout, op(CMOV, 0, 4, 3));        /* 29 */
+    emit(stdout, lv(5, 0));                 /* 30 */
+    emit(stdout, op(LOADP, 0, 5, 0));       /* 31 */
+
+    /* MAPS_EXIT: touch the first few big segments, then halt */
+    for (uint32_t i = 0; i < touched; i++) {
+        emit(stdout, lv(4, 2 + i));
+        emit(stdout, op(SLOAD, 0, 4, 5));
+    }
+    emit(stdout, lv(4, '\n'));
+    emit(stdout, op(OUT, 0, 0, 4));
+    emit(stdout, op(HALT, 0, 0, 0));
+
+    return 0;
+}
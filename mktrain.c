@@ -0,0 +1,170 @@
+/*****************************************************************************
+ *
+ *    mktrain.c
+ *
+ *    Writes the um training program used by "make pgo" to stdout.
+ *
+ *    The program is a mix of the work real um programs do, in two phases.
+ *
+ *    The first is an outer loop that maps a small segment, fills and reads
+ *    it back in an inner loop full of arithmetic, conditional moves and
+ *    jumps (load program of m[0]), then does one input and one output. On
+ *    every COPY_EVERY-th iteration it jumps back to the top through a fresh
+ *    copy of the program instead (load program of another segment).
+ *
+ *    The second maps BIG_ROUNDS large segments one after another, writes
+ *    every word of each and reads every word back.
+ *
+ *    Run it with input from /dev/null and output to /dev/null.
+ *
+ *    Usage: mktrain [outer_iterations] > train.um
+ *
+ *****************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include <assert.h>
+
+#include "umasm.h"
+
+/* Defaults for the shape of the training run */
+static const uint32_t DEFAULT_OUTER = 100000;
+static const uint32_t INNER         = 64;
+static const uint32_t COPY_EVERY    = 16;      /* must be a power of 2 */
+static const uint32_t BIG           = 1 << 20;
+static const uint32_t BIG_ROUNDS    = 4;
+
+/* Largest value a load value instruction can hold */
+static const uint32_t MAX_LV = (1 << 25) - 1;
+
+/* Label addresses in the program below, and its length */
+enum { OUTER_LOOP = 5, INNER_LOOP = 8, INNER_EXIT = 21, PLAIN_JUMP = 33,
+       COPY_JUMP = 38, COPY_LOOP = 41, COPY_EXIT = 50, OUTER_EXIT = 54,
+       BIG_LOOP = 56, FILL_LOOP = 59, FILL_EXIT = 66, READ_LOOP = 67,
+       READ_EXIT = 75, BIG_EXIT = 82, PROG_WORDS = 83 };
+
+int main(int argc, char *argv[])
+{
+    assert(argc <= 2);
+    uint32_t outer = argc == 2 ? strtoul(argv[1], NULL, 10) : DEFAULT_OUTER;
+    assert(outer > 0 && outer <= MAX_LV);
+
+    /* r7 = segment size, r6 = -1, r1 = outer counter, r2 = placeholder */
+    emit(stdout, lv(7, INNER));             /*  0 */
+    emit(stdout, lv(4, 0));                 /*  1 */
+    emit(stdout, op(NAND, 6, 4, 4));        /*  2 */
+    emit(stdout, lv(1, outer));             /*  3 */
+    emit(stdout, op(ACTIVATE, 0, 2, 7));    /*  4 */
+
+    /* OUTER_LOOP: swap r2 for a new segment, r3 = inner counter */
+    emit(stdout, op(INACTIVATE, 0, 0, 2));  /*  5 */
+    emit(stdout, op(ACTIVATE, 0, 2, 7));    /*  6 */
+    emit(stdout, lv(3, INNER));             /*  7 */
+
+    /* INNER_LOOP: mix arithmetic into m[r2][r3] and read it back */
+    emit(stdout, op(ADD, 3, 3, 6));         /*  8 */
+    emit(stdout, op(MUL, 4, 3, 7));         /*  9 */
+    emit(stdout, op(ADD, 4, 4, 1));         /* 10 */
+    emit(stdout, op(DIV, 5, 4, 7));         /* 11 */
+    emit(stdout, op(NAND, 5, 5, 4));        /* 12 */
+    emit(stdout, op(SSTORE, 2, 3, 5));      /* 13 */
+    emit(stdout, op(SLOAD, 4, 2, 3));       /* 14 */
+    emit(stdout, op(CMOV, 5, 4, 3));        /* 15 */
+
+    /* Jump to INNER_LOOP while r3 != 0, else to INNER_EXIT */
+    emit(stdout, lv(0, INNER_EXIT));        /* 16 */
+    emit(stdout, lv(4, INNER_LOOP));        /* 17 */
+    emit(stdout, op(CMOV, 0, 4, 3));        /* 18 */
+    emit(stdout, lv(5, 0));                 /* 19 */
+    emit(stdout, op(LOADP, 0, 5, 0));       /* 20 */
+
+    /* INNER_EXIT: one input, one output, count down */
+    emit(stdout, op(IN, 0, 0, 4));          /* 21 */
+    emit(stdout, lv(4, '.'));               /* 22 */
+    emit(stdout, op(OUT, 0, 0, 4));         /* 23 */
+    emit(stdout, op(ADD, 1, 1, 6));         /* 24 */
+
+    /* Jump to COPY_JUMP if r1 is a multiple of COPY_EVERY, else on */
+    emit(stdout, lv(4, COPY_EVERY - 1));    /* 25 */
+    emit(stdout, op(NAND, 4, 4, 1));        /* 26 */
+    emit(stdout, op(NAND, 3, 4, 4));        /* 27 */
+    emit(stdout, lv(0, COPY_JUMP));         /* 28 */
+    emit(stdout, lv(4, PLAIN_JUMP));        /* 29 */
+    emit(stdout, op(CMOV, 0, 4, 3));        /* 30 */
+    emit(stdout, lv(5, 0));                 /* 31 */
+    emit(stdout, op(LOADP, 0, 5, 0));       /* 32 */
+
+    /* PLAIN_JUMP: to OUTER_LOOP while r1 != 0, else to OUTER_EXIT */
+    emit(stdout, lv(0, OUTER_EXIT));        /* 33 */
+    emit(stdout, lv(4, OUTER_LOOP));        /* 34 */
+    emit(stdout, op(CMOV, 0, 4, 1));        /* 35 */
+    emit(stdout, lv(5, 0));                 /* 36 */
+    emit(stdout, op(LOADP, 0, 5, 0));       /* 37 */
+
+    /* COPY_JUMP: swap r2 for a new segment of PROG_WORDS words */
+    emit(stdout, op(INACTIVATE, 0, 0, 2));  /* 38 */
+    emit(stdout, lv(3, PROG_WORDS));        /* 39 */
+    emit(stdout, op(ACTIVATE, 0, 2, 3));    /* 40 */
+
+    /* COPY_LOOP: copy m[0] into m[r2], last word first */
+    emit(stdout, op(ADD, 3, 3, 6));         /* 41 */
+    emit(stdout, lv(5, 0));                 /* 42 */
+    emit(stdout, op(SLOAD, 4, 5, 3));       /* 43 */
+    emit(stdout, op(SSTORE, 2, 3, 4));      /* 44 */
+    emit(stdout, lv(0, COPY_EXIT));         /* 45 */
+    emit(stdout, lv(4, COPY_LOOP));         /* 46 */
+    emit(stdout, op(CMOV, 0, 4, 3));        /* 47 */
+    emit(stdout, lv(5, 0));                 /* 48 */
+    emit(stdout, op(LOADP, 0, 5, 0));       /* 49 */
+
+    /* COPY_EXIT: as PLAIN_JUMP, but load the copy in m[r2] as m[0] */
+    emit(stdout, lv(0, OUTER_EXIT));        /* 50 */
+    emit(stdout, lv(4, OUTER_LOOP));        /* 51 */
+    emit(stdout, op(CMOV, 0, 4, 1));        /* 52 */
+    emit(stdout, op(LOADP, 0, 2, 0));       /* 53 */
+
+    /* OUTER_EXIT: unmap r2, r1 = big segment rounds left */
+    emit(stdout, op(INACTIVATE, 0, 0, 2));  /* 54 */
+    emit(stdout, lv(1, BIG_ROUNDS));        /* 55 */
+
+    /* BIG_LOOP: r2 = new big segment, r3 = index */
+    emit(stdout, lv(7, BIG));               /* 56 */
+    emit(stdout, op(ACTIVATE, 0, 2, 7));    /* 57 */
+    emit(stdout, lv(3, BIG));               /* 58 */
+
+    /* FILL_LOOP: m[r2][r3] = r3, last word first */
+    emit(stdout, op(ADD, 3, 3, 6));         /* 59 */
+    emit(stdout, op(SSTORE, 2, 3, 3));      /* 60 */
+    emit(stdout, lv(0, FILL_EXIT));         /* 61 */
+    emit(stdout, lv(4, FILL_LOOP));         /* 62 */
+    emit(stdout, op(CMOV, 0, 4, 3));        /* 63 */
+    emit(stdout, lv(5, 0));                 /* 64 */
+    emit(stdout, op(LOADP, 0, 5, 0));       /* 65 */
+
+    /* FILL_EXIT / READ_LOOP: add every word of m[r2] into r7 */
+    emit(stdout, lv(3, BIG));               /* 66 */
+    emit(stdout, op(ADD, 3, 3, 6));         /* 67 */
+    emit(stdout, op(SLOAD, 5, 2, 3));       /* 68 */
+    emit(stdout, op(ADD, 7, 7, 5));         /* 69 */
+    emit(stdout, lv(0, READ_EXIT));         /* 70 */
+    emit(stdout, lv(4, READ_LOOP));         /* 71 */
+    emit(stdout, op(CMOV, 0, 4, 3));        /* 72 */
+    emit(stdout, lv(5, 0));                 /* 73 */
+    emit(stdout, op(LOADP, 0, 5, 0));       /* 74 */
+
+    /* READ_EXIT: unmap, and go to BIG_LOOP while rounds are left */
+    emit(stdout, op(INACTIVATE, 0, 0, 2));  /* 75 */
+    emit(stdout, op(ADD, 1, 1, 6));         /* 76 */
+    emit(stdout, lv(0, BIG_EXIT));          /* 77 */
+    emit(stdout, lv(4, BIG_LOOP));          /* 78 */
+    emit(stdout, op(CMOV, 0, 4, 1));        /* 79 */
+    emit(stdout, lv(5, 0));                 /* 80 */
+    emit(stdout, op(LOADP, 0, 5, 0));       /* 81 */
+
+    /* BIG_EXIT */
+    uint32_t emitted = emit(stdout, op(HALT, 0, 0, 0));  /* 82 */
+
+    assert(emitted == PROG_WORDS);
+    return 0;
+}
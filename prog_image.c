@@ -0,0 +1,444 @@
+/*****************************************************************************
+ *
+ *    prog_image.c
+ *
+ *    Prog_image module implementation for use by seg_mem.
+ *
+ *    Caches decoded programs (the m[0] segment, in native byte order and
+ *    with its size in word 0) in a cache directory, one file per program:
+ *        <dir>/<digest>.img
+ *    where digest is the SHA-256 of an engine identifier followed by the
+ *    contents of the .um file. The engine identifier names the image
+ *    format (IMAGE_VERSION) and the um executable that wrote the image, so
+ *    a rebuilt um never picks up images made by another build. The full
+ *    digest and engine identifier are also kept in the image header, and a
+ *    hit is trusted once they match; the image is not re-decoded.
+ *
+ *    Caching is off unless $UM_CACHE_DIR names the cache directory. After
+ *    each store, the least recently used images are deleted until the
+ *    directory holds at most CACHE_MAX_BYTES of images.
+ *
+ *    A hit maps the file privately (copy-on-write), so m[0] points straight
+ *    into the mapping and the um can still store to it. Images are written
+ *    to a temporary file and renamed into place, so readers never see a
+ *    partial image. Caching is best effort: any failure falls back to
+ *    decoding the program file as usual.
+ *
+ *****************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "assert.h"
+#include "sha256.h"
+#include "prog_image.h"
+
+/* Constants for image files */
+static const char     IMAGE_MAGIC[8] = "UMIMAGE";
+static const uint32_t BYTE_ORDER_TAG = 0x01020304;
+
+/* Most bytes of images the cache directory may hold */
+static const uint64_t CACHE_MAX_BYTES = (uint64_t)256 << 20;
+
+/* Header at the start of every image file, followed by the segment */
+typedef struct image_header {
+    char     magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    uint64_t src_len;
+    uint32_t nwords;
+    uint32_t pad;
+    unsigned char digest[SHA256_BYTES];
+    char     engine[IMAGE_ENGINE_LEN];
+} image_header;
+
+/**************************************************************************
+*                           Naming cache files                            *
+***************************************************************************/
+/*
+ * engine_id()
+ * Parameters: buffer of IMAGE_ENGINE_LEN bytes
+ * Fills the buffer (zero padded) with an identifier of the image format
+ * and of the running um executable (its inode, size and modification
+ * time), so that images are only shared by runs of the same build
+ * Returns nothing
+ */
+static void engine_id(char engine[IMAGE_ENGINE_LEN])
+{
+    memset(engine, 0, IMAGE_ENGINE_LEN);
+    struct stat st;
+    if (stat("/proc/self/exe", &st) == 0) {
+        snprintf(engine, IMAGE_ENGINE_LEN,
+                 "um-image-v%d %llx:%llx %lld %lld.%09ld", IMAGE_VERSION,
+                 (unsigned long long)st.st_dev,
+                 (unsigned long long)st.st_ino, (long long)st.st_size,
+                 (long long)st.st_mtim.tv_sec, (long)st.st_mtim.tv_nsec);
+    } else {
+        snprintf(engine, IMAGE_ENGINE_LEN, "um-image-v%d", IMAGE_VERSION);
+    }
+}
+
+/*
+ * cache_dir()
+ * Returns a newly allocated copy of $UM_CACHE_DIR, or NULL if it is unset
+ * or empty (caching is off)
+ */
+static char *cache_dir(void)
+{
+    const char *dir = getenv("UM_CACHE_DIR");
+    if (dir == NULL || dir[0] == '\0') {
+        return NULL;
+    }
+
+    size_t len = strlen(dir) + 1;
+    char *path = malloc(len);
+    assert(path != NULL);
+    memcpy(path, dir, len);
+    return path;
+}
+
+/*
+ * make_dirs()
+ * Parameters: a directory path (modified temporarily)
+ * Creates the directory and any missing parents
+ * Returns true if the directory exists afterwards
+ */
+static bool make_dirs(char *path)
+{
+    for (char *p = path + 1; *p != '\0'; p++) {
+        if (*p == '/') {
+            *p = '\0';
+            mkdir(path, 0777);
+            *p = '/';
+        }
+    }
+    return mkdir(path, 0777) == 0 || errno == EEXIST;
+}
+
+/**************************************************************************
+*                        Loading and saving images                        *
+***************************************************************************/
+/*
+ * image_init()
+ * Parameters: a prog_image pointer
+ * Sets up an image with no cache file and nothing loaded
+ * Returns nothing
+ */
+void image_init(prog_image *img)
+{
+    assert(img != NULL);
+    img->path    = NULL;
+    img->map     = NULL;
+    img->map_len = 0;
+    memset(img->engine, 0, IMAGE_ENGINE_LEN);
+    memset(img->digest, 0, SHA256_BYTES);
+    img->src_len = 0;
+}
+
+/*
+ * map_image()
+ * Parameters: a prog_image pointer whose path, engine, digest and src_len
+ *             are set
+ * Maps the image at img->path if its header matches this program and
+ * build, and marks it as recently used
+ * Returns the cached m[0] segment, or NULL if there is no such image
+ */
+static uint32_t *map_image(prog_image *img)
+{
+    int img_fd = open(img->path, O_RDONLY);
+    if (img_fd < 0) {
+        return NULL;
+    }
+    struct stat st;
+    if (fstat(img_fd, &st) != 0 || (size_t)st.st_size < sizeof(image_header)) {
+        close(img_fd);
+        return NULL;
+    }
+    void *map = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE,
+                     img_fd, 0);
+    close(img_fd);
+    if (map == MAP_FAILED) {
+        return NULL;
+    }
+
+    image_header *header = map;
+    uint32_t *seg = (uint32_t *)(header + 1);
+    size_t expected = sizeof(*header)
+                      + ((size_t)header->nwords + 1) * sizeof(*seg);
+    if (memcmp(header->magic, IMAGE_MAGIC, sizeof(IMAGE_MAGIC)) != 0
+        || header->version != IMAGE_VERSION
+        || header->byte_order != BYTE_ORDER_TAG
+        || header->src_len != img->src_len
+        || memcmp(header->digest, img->digest, SHA256_BYTES) != 0
+        || memcmp(header->engine, img->engine, IMAGE_ENGINE_LEN) != 0
+        || (size_t)st.st_size != expected || seg[0] != header->nwords) {
+        munmap(map, st.st_size);
+        return NULL;
+    }
+
+    /* Eviction goes by modification time, so a hit counts as a use */
+    utimensat(AT_FDCWD, img->path, NULL, 0);
+
+    img->map     = map;
+    img->map_len = st.st_size;
+    return seg;
+}
+
+/*
+ * image_load()
+ * Parameters: a prog_image pointer, FILE * to file containing um program
+ * Digests the program file to find its cache file and maps the cached
+ * image if there is a valid one. On a miss, remembers the cache file name
+ * so that image_store() can fill it in. Does not move the file position.
+ * Returns the cached m[0] segment, or NULL on a miss or if caching is off
+ */
+uint32_t* image_load(prog_image *img, FILE *prog)
+{
+    assert(img != NULL && prog != NULL && img->path == NULL);
+
+    char *dir = cache_dir();
+    if (dir == NULL) {
+        return NULL;
+    }
+    int fd = fileno(prog);
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size == 0) {
+        free(dir);
+        return NULL;
+    }
+
+    /* Digest the engine identifier and the program file */
+    size_t src_len = st.st_size;
+    void *src = mmap(NULL, src_len, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (src == MAP_FAILED) {
+        free(dir);
+        return NULL;
+    }
+    engine_id(img->engine);
+    sha256_ctx ctx;
+    sha256_init(&ctx);
+    sha256_update(&ctx, img->engine, IMAGE_ENGINE_LEN);
+    sha256_update(&ctx, src, src_len);
+    sha256_final(&ctx, img->digest);
+    munmap(src, src_len);
+    img->src_len = src_len;
+
+    size_t len = strlen(dir) + 2 * SHA256_BYTES + 8;
+    img->path = malloc(len);
+    assert(img->path != NULL);
+    size_t pos = snprintf(img->path, len, "%s/", dir);
+    for (int i = 0; i < SHA256_BYTES; i++) {
+        pos += snprintf(img->path + pos, len - pos, "%02x", img->digest[i]);
+    }
+    snprintf(img->path + pos, len - pos, ".img");
+    free(dir);
+
+    return map_image(img);
+}
+
+/*
+ * write_all()
+ * Parameters: a file descriptor, bytes to write, number of bytes
+ * Writes all of the bytes, retrying short writes
+ * Returns true on success
+ */
+static bool write_all(int fd, const void *bytes, size_t len)
+{
+    const char *p = bytes;
+    while (len > 0) {
+        ssize_t nwritten = write(fd, p, len);
+        if (nwritten < 0 && errno == EINTR) {
+            continue;
+        }
+        if (nwritten <= 0) {
+            return false;
+        }
+        p   += nwritten;
+        len -= nwritten;
+    }
+    return true;
+}
+
+/* One image file found by evict() */
+typedef struct cache_entry {
+    char *path;
+    uint64_t bytes;
+    struct timespec used;
+} cache_entry;
+
+/*
+ * older_first()
+ * Compares two cache_entry structs by modification time, for qsort()
+ */
+static int older_first(const void *a, const void *b)
+{
+    const struct timespec *x = &((const cache_entry *)a)->used;
+    const struct timespec *y = &((const cache_entry *)b)->used;
+    if (x->tv_sec != y->tv_sec) {
+        return x->tv_sec < y->tv_sec ? -1 : 1;
+    }
+    return (x->tv_nsec > y->tv_nsec) - (x->tv_nsec < y->tv_nsec);
+}
+
+/*
+ * evict()
+ * Parameters: path of an image in the cache directory
+ * Deletes the least recently used images in that directory until the
+ * images left take at most CACHE_MAX_BYTES
+ * Returns nothing
+ */
+static void evict(const char *image_path)
+{
+    size_t dir_len = strrchr(image_path, '/') - image_path;
+    char *dir = malloc(dir_len + 1);
+    assert(dir != NULL);
+    memcpy(dir, image_path, dir_len);
+    dir[dir_len] = '\0';
+
+    DIR *d = opendir(dir);
+    if (d == NULL) {
+        free(dir);
+        return;
+    }
+
+    cache_entry *entries = NULL;
+    size_t count = 0, cap = 0;
+    uint64_t total = 0;
+    struct dirent *de;
+    while ((de = readdir(d)) != NULL) {
+        size_t name_len = strlen(de->d_name);
+        if (name_len < 4 || strcmp(de->d_name + name_len - 4, ".img") != 0) {
+            continue;
+        }
+        char *path = malloc(dir_len + name_len + 2);
+        assert(path != NULL);
+        snprintf(path, dir_len + name_len + 2, "%s/%s", dir, de->d_name);
+        struct stat st;
+        if (stat(path, &st) != 0 || !S_ISREG(st.st_mode)) {
+            free(path);
+            continue;
+        }
+
+        if (count == cap) {
+            cap = cap ? cap * 2 : 16;
+            entries = realloc(entries, cap * sizeof(*entries));
+            assert(entries != NULL);
+        }
+        entries[count].path  = path;
+        entries[count].bytes = st.st_size;
+        entries[count].used  = st.st_mtim;
+        count++;
+        total += st.st_size;
+    }
+    closedir(d);
+    free(dir);
+
+    if (total > CACHE_MAX_BYTES) {
+        qsort(entries, count, sizeof(*entries), older_first);
+        for (size_t i = 0; i < count && total > CACHE_MAX_BYTES; i++) {
+            if (unlink(entries[i].path) == 0) {
+                total -= entries[i].bytes;
+            }
+        }
+    }
+    for (size_t i = 0; i < count; i++) {
+        free(entries[i].path);
+    }
+    free(entries);
+}
+
+/*
+ * image_store()
+ * Parameters: a prog_image pointer on which image_load() missed, the
+ *             freshly decoded m[0] segment
+ * Writes the segment to the program's cache file via a temporary file
+ * and rename(), so the cache file appears all at once
+ * Returns nothing
+ */
+void image_store(prog_image *img, const uint32_t *seg)
+{
+    assert(img != NULL && seg != NULL);
+    size_t seg_len = ((size_t)seg[0] + 1) * sizeof(*seg);
+    if (img->path == NULL
+        || sizeof(image_header) + seg_len > CACHE_MAX_BYTES) {
+        return;
+    }
+
+    size_t len = strlen(img->path);
+    char *dir = malloc(len + 1);
+    char *tmp = malloc(len + 8);
+    assert(dir != NULL && tmp != NULL);
+    memcpy(dir, img->path, len + 1);
+    *strrchr(dir, '/') = '\0';
+    snprintf(tmp, len + 8, "%s.XXXXXX", img->path);
+
+    int fd = -1;
+    if (make_dirs(dir)) {
+        fd = mkstemp(tmp);
+    }
+    free(dir);
+    if (fd < 0) {
+        free(tmp);
+        return;
+    }
+
+    image_header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, IMAGE_MAGIC, sizeof(IMAGE_MAGIC));
+    header.version    = IMAGE_VERSION;
+    header.byte_order = BYTE_ORDER_TAG;
+    header.src_len    = img->src_len;
+    header.nwords     = seg[0];
+    memcpy(header.digest, img->digest, SHA256_BYTES);
+    memcpy(header.engine, img->engine, IMAGE_ENGINE_LEN);
+
+    bool ok = write_all(fd, &header, sizeof(header))
+              && write_all(fd, seg, seg_len);
+    ok = (close(fd) == 0) && ok;
+    if (!ok || rename(tmp, img->path) != 0) {
+        unlink(tmp);
+    }
+    free(tmp);
+
+    evict(img->path);
+}
+
+/**************************************************************************
+*                           Releasing images                              *
+***************************************************************************/
+/*
+ * image_owns()
+ * Parameters: a prog_image pointer, a segment
+ * Returns true if seg is the m[0] segment inside the loaded image (and so
+ * must be released with image_release() rather than free())
+ */
+bool image_owns(prog_image *img, const uint32_t *seg)
+{
+    assert(img != NULL);
+    return img->map != NULL
+           && seg == (const uint32_t *)((image_header *)img->map + 1);
+}
+
+/*
+ * image_release()
+ * Parameters: a prog_image pointer
+ * Unmaps the loaded image, if any, and forgets the cache file name
+ * Returns nothing
+ */
+void image_release(prog_image *img)
+{
+    assert(img != NULL);
+    if (img->map != NULL) {
+        munmap(img->map, img->map_len);
+    }
+    free(img->path);
+    image_init(img);
+}
@@ -0,0 +1,42 @@
+/*****************************************************************************
+ *
+ *    prog_image.h
+ *
+ *    Header file for prog_image module, an opt-in on-disk cache of decoded
+ *    um programs keyed by a SHA-256 digest of the program file
+ *
+ *****************************************************************************/
+#ifndef PROG_IMAGE_H
+#define PROG_IMAGE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "sha256.h"
+
+/* Bump whenever the image layout or the preprocessing behind it changes */
+#define IMAGE_VERSION 3
+
+/* Size of the engine identifier stored in (and hashed into) every image */
+#define IMAGE_ENGINE_LEN 64
+
+typedef struct prog_image {
+    char *path;         /* cache file for this program, NULL if caching off */
+    void *map;          /* mapping of the cache file, NULL if not loaded */
+    size_t map_len;
+    char engine[IMAGE_ENGINE_LEN];          /* which build made the image */
+    unsigned char digest[SHA256_BYTES];     /* of engine and program file */
+    uint64_t src_len;                       /* length of the program file */
+} prog_image;
+
+/* Functions to find, load, and save cached program images */
+void      image_init   (prog_image *img);
+uint32_t* image_load   (prog_image *img, FILE *prog);
+void      image_store  (prog_image *img, const uint32_t *seg);
+
+/* Functions for freeing a segment that may live in a loaded image */
+bool      image_owns   (prog_image *img, const uint32_t *seg);
+void      image_release(prog_image *img);
+
+#endif
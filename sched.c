@@ -0,0 +1,381 @@
+/*****************************************************************************
+ *
+ *    sched.c
+ *
+ *    Sched module implementation. Runs many um objects in one process by
+ *    handing each one to a worker thread for at most "quantum" instructions
+ *    (see um_step()) and then putting it at the back of a shared run queue,
+ *    so every runnable um gets a fair round-robin share of the workers.
+ *
+ *    Each um also has a fuel allowance: the total number of instructions it
+ *    may execute before the scheduler retires it (its status is left at
+ *    UM_RUNNING in that case).
+ *
+ *    A um that stops on an "in" instruction with no input available has
+ *    its output flushed and is parked: instead of going back on the run
+ *    queue, its input descriptor is armed in an epoll set with
+ *    EPOLLONESHOT. A single poller thread waits on that set and puts each
+ *    um whose input became readable back on the run queue. Parking costs
+ *    O(1) however many ums are waiting. An entry watches the um's own
+ *    descriptor, or a dup() of it if another um already watches the same
+ *    one (epoll allows each descriptor in a set only once). A
+ *    self-pipe in the same set wakes the poller when all ums are done.
+ *
+ *    Ums may share an input file. sched_add() makes every um's input
+ *    descriptor non-blocking, so when input arrives and several of them
+ *    race to read it, the losers come back from um_step() blocked again
+ *    and are re-parked instead of stalling a worker in read().
+ *
+ *****************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+
+#include "assert.h"
+#include "sched.h"
+#include "um.h"
+
+/* Number of events the poller takes from epoll_wait() at a time */
+#define POLL_BATCH 64
+
+/* One scheduled um, kept on the run queue unless parked */
+typedef struct sched_entry {
+    um_obj *um;
+    uint64_t fuel;
+    int watch_fd;               /* the um's input (or a dup) in epoll set */
+    bool owns_watch;            /* watch_fd is a dup we must close */
+    struct sched_entry *next;
+} sched_entry;
+
+struct um_sched {
+    pthread_mutex_t lock;
+    pthread_cond_t  runnable;   /* run queue non-empty, or all ums done */
+
+    sched_entry *run_head;      /* run queue, served in FIFO order */
+    sched_entry *run_tail;
+    unsigned live;              /* ums that have not halted/run dry */
+
+    unsigned nworkers;
+    uint32_t quantum;
+    int epoll_fd;               /* input descriptors of parked ums */
+    int wake[2];                /* self-pipe used to stop the poller */
+};
+
+/**************************************************************************
+*                          Queue helper functions                         *
+***************************************************************************/
+/*
+ * enqueue()
+ * Parameters: a scheduler (with its lock held), an entry
+ * Puts entry at the back of the run queue and wakes one worker
+ * Returns nothing
+ */
+static void enqueue(um_sched *sched, sched_entry *entry)
+{
+    entry->next = NULL;
+    if (sched->run_tail == NULL) {
+        sched->run_head = entry;
+    } else {
+        sched->run_tail->next = entry;
+    }
+    sched->run_tail = entry;
+    pthread_cond_signal(&sched->runnable);
+}
+
+/*
+ * dequeue()
+ * Parameters: a scheduler (with its lock held)
+ * Waits until the run queue is non-empty or every um is done
+ * Returns the entry at the front of the run queue, or NULL if all are done
+ */
+static sched_entry *dequeue(um_sched *sched)
+{
+    while (sched->run_head == NULL && sched->live > 0) {
+        pthread_cond_wait(&sched->runnable, &sched->lock);
+    }
+    if (sched->run_head == NULL) {
+        return NULL;
+    }
+
+    sched_entry *entry = sched->run_head;
+    sched->run_head = entry->next;
+    if (sched->run_head == NULL) {
+        sched->run_tail = NULL;
+    }
+    return entry;
+}
+
+/*
+ * wake_poller()
+ * Parameters: a scheduler
+ * Writes a byte to the self-pipe so the poller notices all ums are done
+ * Returns nothing
+ */
+static void wake_poller(um_sched *sched)
+{
+    char byte = 0;
+    ssize_t nwritten;
+    do {
+        nwritten = write(sched->wake[1], &byte, 1);
+    } while (nwritten < 0 && errno == EINTR);
+
+    /* A full pipe already guarantees the poller will wake up */
+    assert(nwritten == 1 || errno == EAGAIN);
+}
+
+/*
+ * park()
+ * Parameters: a scheduler, an entry whose um is blocked on input
+ * Arms the um's input descriptor in the epoll set; once it is readable
+ * the poller puts the entry back on the run queue. The caller must not
+ * touch entry afterwards.
+ * Returns nothing
+ */
+static void park(um_sched *sched, sched_entry *entry)
+{
+    struct epoll_event event = { .events = EPOLLIN | EPOLLONESHOT,
+                                 .data.ptr = entry };
+    int result;
+    if (entry->watch_fd < 0) {
+        entry->watch_fd = entry->um->io.in_fd;
+        result = epoll_ctl(sched->epoll_fd, EPOLL_CTL_ADD, entry->watch_fd,
+                           &event);
+        if (result != 0 && errno == EEXIST) {
+            entry->watch_fd = dup(entry->um->io.in_fd);
+            assert(entry->watch_fd >= 0);
+            entry->owns_watch = true;
+            result = epoll_ctl(sched->epoll_fd, EPOLL_CTL_ADD,
+                               entry->watch_fd, &event);
+        }
+    } else {
+        result = epoll_ctl(sched->epoll_fd, EPOLL_CTL_MOD, entry->watch_fd,
+                           &event);
+    }
+    assert(result == 0);
+}
+
+/**************************************************************************
+*                            Scheduler threads                            *
+***************************************************************************/
+/*
+ * worker()
+ * Parameters: a scheduler (as a void pointer)
+ * Repeatedly takes the um at the front of the run queue, runs it for one
+ * quantum (or whatever fuel it has left), and requeues, parks, or retires
+ * it depending on how it stopped
+ * Returns NULL once every um is done
+ */
+static void *worker(void *arg)
+{
+    um_sched *sched = arg;
+
+    pthread_mutex_lock(&sched->lock);
+    sched_entry *entry;
+    while ((entry = dequeue(sched)) != NULL) {
+        pthread_mutex_unlock(&sched->lock);
+
+        uint32_t budget = sched->quantum;
+        if (entry->fuel < budget) {
+            budget = entry->fuel;
+        }
+        uint64_t before = entry->um->executed;
+        um_status status = um_step(entry->um, budget);
+        if (entry->fuel != SCHED_UNLIMITED) {
+            entry->fuel -= entry->um->executed - before;
+        }
+
+        /* Send a blocked um's prompt to its client before parking it */
+        if (status == UM_BLOCKED) {
+            fflush(entry->um->io.out);
+        }
+
+        pthread_mutex_lock(&sched->lock);
+        if (status == UM_HALTED || entry->fuel == 0) {
+            /*
+             * Deregister before closing a dup: the registration belongs to
+             * the open file, which the um's own descriptor keeps alive
+             */
+            if (entry->watch_fd >= 0) {
+                epoll_ctl(sched->epoll_fd, EPOLL_CTL_DEL, entry->watch_fd,
+                          NULL);
+            }
+            if (entry->owns_watch) {
+                close(entry->watch_fd);
+            }
+            free(entry);
+            sched->live--;
+            if (sched->live == 0) {
+                pthread_cond_broadcast(&sched->runnable);
+                wake_poller(sched);
+            }
+        } else if (status == UM_BLOCKED) {
+            park(sched, entry);
+        } else {
+            enqueue(sched, entry);
+        }
+    }
+    pthread_mutex_unlock(&sched->lock);
+
+    return NULL;
+}
+
+/*
+ * poller()
+ * Parameters: a scheduler (as a void pointer)
+ * Waits on the epoll set and moves every um whose input became readable
+ * back onto the run queue
+ * Returns NULL once every um is done
+ */
+static void *poller(void *arg)
+{
+    um_sched *sched = arg;
+    struct epoll_event events[POLL_BATCH];
+
+    pthread_mutex_lock(&sched->lock);
+    while (sched->live > 0) {
+        pthread_mutex_unlock(&sched->lock);
+
+        int nready = epoll_wait(sched->epoll_fd, events, POLL_BATCH, -1);
+        assert(nready >= 0 || errno == EINTR);
+
+        pthread_mutex_lock(&sched->lock);
+        for (int i = 0; i < nready; i++) {
+            sched_entry *entry = events[i].data.ptr;
+            if (entry != NULL) {
+                enqueue(sched, entry);
+            }
+        }
+    }
+    pthread_mutex_unlock(&sched->lock);
+
+    return NULL;
+}
+
+/**************************************************************************
+*                     Create/fill/run/free a scheduler                    *
+***************************************************************************/
+/*
+ * sched_new()
+ * Parameters: number of worker threads; instructions per time slice
+ * Returns: a pointer to a newly allocated, empty scheduler
+ */
+um_sched* sched_new(unsigned workers, uint32_t quantum)
+{
+    assert(workers > 0 && quantum > 0);
+    um_sched *sched = malloc(sizeof(*sched));
+    assert(sched != NULL);
+
+    pthread_mutex_init(&sched->lock, NULL);
+    pthread_cond_init(&sched->runnable, NULL);
+    sched->run_head = NULL;
+    sched->run_tail = NULL;
+    sched->live     = 0;
+    sched->nworkers = workers;
+    sched->quantum  = quantum;
+
+    /* Non-blocking so neither side of the self-pipe can ever stall us */
+    int result = pipe(sched->wake);
+    assert(result == 0);
+    for (int i = 0; i < 2; i++) {
+        result = fcntl(sched->wake[i], F_SETFL, O_NONBLOCK);
+        assert(result == 0);
+    }
+
+    /* The self-pipe stays armed (level-triggered) with a NULL entry */
+    sched->epoll_fd = epoll_create1(0);
+    assert(sched->epoll_fd >= 0);
+    struct epoll_event event = { .events = EPOLLIN, .data.ptr = NULL };
+    result = epoll_ctl(sched->epoll_fd, EPOLL_CTL_ADD, sched->wake[0], &event);
+    assert(result == 0);
+
+    return sched;
+}
+
+/*
+ * sched_add()
+ * Parameters: a scheduler; an initialized um; its fuel (total number of
+ *             instructions it may run, or SCHED_UNLIMITED)
+ * Puts the um on the run queue and makes its input descriptor
+ * non-blocking (which affects every descriptor for the same open file).
+ * The scheduler does not take ownership of the um; the client frees it
+ * after sched_run() returns.
+ * Returns nothing
+ */
+void sched_add(um_sched *sched, um_obj *um, uint64_t fuel)
+{
+    assert(sched != NULL && um != NULL);
+    if (fuel == 0 || um->status == UM_HALTED) {
+        return;
+    }
+
+    int flags = fcntl(um->io.in_fd, F_GETFL);
+    assert(flags >= 0);
+    if ((flags & O_NONBLOCK) == 0) {
+        int result = fcntl(um->io.in_fd, F_SETFL, flags | O_NONBLOCK);
+        assert(result == 0);
+    }
+
+    sched_entry *entry = malloc(sizeof(*entry));
+    assert(entry != NULL);
+    entry->um         = um;
+    entry->fuel       = fuel;
+    entry->watch_fd   = -1;
+    entry->owns_watch = false;
+
+    pthread_mutex_lock(&sched->lock);
+    sched->live++;
+    enqueue(sched, entry);
+    pthread_mutex_unlock(&sched->lock);
+}
+
+/*
+ * sched_run()
+ * Parameters: a scheduler
+ * Starts the worker and poller threads and waits until every um added to
+ * the scheduler has halted or used up its fuel
+ * Returns nothing
+ */
+void sched_run(um_sched *sched)
+{
+    assert(sched != NULL);
+    pthread_t *workers = malloc(sched->nworkers * sizeof(*workers));
+    assert(workers != NULL);
+    pthread_t poll_thread;
+
+    int result = pthread_create(&poll_thread, NULL, poller, sched);
+    assert(result == 0);
+    for (unsigned i = 0; i < sched->nworkers; i++) {
+        result = pthread_create(&workers[i], NULL, worker, sched);
+        assert(result == 0);
+    }
+
+    for (unsigned i = 0; i < sched->nworkers; i++) {
+        pthread_join(workers[i], NULL);
+    }
+    pthread_join(poll_thread, NULL);
+
+    free(workers);
+}
+
+/*
+ * sched_free()
+ * Parameters: a scheduler
+ * Frees memory associated with the scheduler (but not its ums)
+ * Returns nothing
+ */
+void sched_free(um_sched *sched)
+{
+    assert(sched != NULL && sched->live == 0);
+    close(sched->epoll_fd);
+    close(sched->wake[0]);
+    close(sched->wake[1]);
+    pthread_cond_destroy(&sched->runnable);
+    pthread_mutex_destroy(&sched->lock);
+    free(sched);
+}
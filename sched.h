@@ -0,0 +1,26 @@
+/*****************************************************************************
+ *
+ *    sched.h
+ *
+ *    Header file for the sched module, which time-slices many ums over a
+ *    fixed pool of worker threads
+ *
+ *****************************************************************************/
+#ifndef SCHED_H
+#define SCHED_H
+
+#include <stdint.h>
+#include "um.h"
+
+/* Fuel value for a um that may run for as long as it likes */
+#define SCHED_UNLIMITED UINT64_MAX
+
+typedef struct um_sched um_sched;
+
+/* Functions to create, fill, run, and free a scheduler */
+um_sched* sched_new (unsigned workers, uint32_t quantum);
+void      sched_add (um_sched *sched, um_obj *um, uint64_t fuel);
+void      sched_run (um_sched *sched);
+void      sched_free(um_sched *sched);
+
+#endif
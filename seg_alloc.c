@@ -0,0 +1,221 @@
+/*****************************************************************************
+ *
+ *    seg_alloc.c
+ *
+ *    Seg_alloc module implementation for use by seg_mem and seg_cold.
+ *
+ *    By default segments are allocated with calloc(). Once seg_alloc_huge()
+ *    is called, the program read in at startup (the first m[0]) and every
+ *    segment of at least min_words words are instead mapped in whole 2 MiB
+ *    huge pages, to cut dTLB/iTLB misses on big heaps and on instruction
+ *    fetch. We first try a hugetlbfs mapping (MAP_HUGETLB, which needs
+ *    pages reserved in vm.nr_hugepages), then a 2 MiB aligned anonymous
+ *    mapping marked MADV_HUGEPAGE for transparent huge pages, and finally
+ *    fall back to calloc().
+ *
+ *    Every segment is preceded by a hidden header recording how it was
+ *    allocated, so seg_free() can release it the same way. In a huge page
+ *    segment the header and the size word (m[id][0]) sit at the end of an
+ *    ordinary page mapped just below the huge pages, and the segment's
+ *    words start on a 2 MiB boundary. A segment of 2^k words (k >= 19) so
+ *    takes exactly 2^k words of huge pages.
+ *
+ *    seg_alloc_huge() must be called before any segment is allocated, and
+ *    before any other threads are started.
+ *
+ *****************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "assert.h"
+#include "seg_alloc.h"
+
+/* How a segment was allocated, kept in its header */
+typedef enum seg_backing {
+        BACKING_MALLOC = 0, BACKING_HUGETLB, BACKING_THP, NUM_BACKINGS
+} seg_backing;
+
+/* Header words before each segment (two words, to keep 8-byte alignment) */
+#define HEADER_WORDS 2
+
+static const size_t HUGE_PAGE_SIZE = (size_t)2 << 20;
+
+/* Settings made by seg_alloc_huge() */
+static bool     huge_on = false;
+static uint32_t huge_min_words;
+static size_t   page_size;
+
+/* Number of segments allocated with each backing, for seg_alloc_report() */
+static uint64_t backing_counts[NUM_BACKINGS];
+
+/*
+ * seg_alloc_huge()
+ * Parameters: smallest segment size (in words) to back with huge pages
+ * Turns on huge pages for m[0] and for segments of at least min_words
+ * Returns nothing
+ */
+void seg_alloc_huge(uint32_t min_words)
+{
+    huge_on = true;
+    huge_min_words = min_words;
+    page_size = sysconf(_SC_PAGESIZE);
+    assert(page_size >= (HEADER_WORDS + 1) * sizeof(uint32_t));
+}
+
+/*
+ * seg_alloc_huge_on()
+ * Returns true if seg_alloc_huge() has been called
+ */
+bool seg_alloc_huge_on(void)
+{
+    return huge_on;
+}
+
+/*
+ * map_bytes()
+ * Parameters: segment size in words
+ * Returns the size of the huge page mapping that holds the segment's words
+ * (not counting the size word, which lives in the page below it)
+ */
+static size_t map_bytes(uint32_t size)
+{
+    size_t bytes = (size_t)size * sizeof(uint32_t);
+    if (bytes == 0) {
+        bytes = 1;
+    }
+    return (bytes + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+}
+
+/*
+ * map_huge()
+ * Parameters: number of bytes (a multiple of HUGE_PAGE_SIZE), pointer to
+ *             where to record the backing that was used
+ * Maps an ordinary page followed by a 2 MiB aligned run of bytes backed by
+ * huge pages where possible
+ * Returns the start of the huge pages (the page below holds the segment
+ * header), zero-filled, or NULL if no mapping could be made
+ */
+static void *map_huge(size_t bytes, seg_backing *backing)
+{
+    /*
+     * Reserve room for the page, the huge pages and slack to align them,
+     * then trim the reservation around what we use
+     */
+    size_t reserved = page_size + bytes + HUGE_PAGE_SIZE;
+    char *raw = mmap(NULL, reserved, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (raw == MAP_FAILED) {
+        return NULL;
+    }
+    char *data = (char *)(((uintptr_t)raw + page_size + HUGE_PAGE_SIZE - 1)
+                          & ~(uintptr_t)(HUGE_PAGE_SIZE - 1));
+    char *start = data - page_size;
+    if (start > raw) {
+        munmap(raw, start - raw);
+    }
+    char *end = raw + reserved;
+    if (end > data + bytes) {
+        munmap(data + bytes, end - (data + bytes));
+    }
+
+#ifdef MAP_HUGETLB
+    void *mem = mmap(data, bytes, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | MAP_FIXED,
+                     -1, 0);
+    if (mem != MAP_FAILED) {
+        *backing = BACKING_HUGETLB;
+        return data;
+    }
+
+    /*
+     * A failed MAP_FIXED may already have unmapped the range, so map it
+     * again with ordinary pages
+     */
+    mem = mmap(data, bytes, PROT_READ | PROT_WRITE,
+               MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0);
+    if (mem == MAP_FAILED) {
+        munmap(start, page_size);
+        return NULL;
+    }
+#endif
+
+#ifdef MADV_HUGEPAGE
+    /* Only a hint: without THP support the pages simply stay small */
+    madvise(data, bytes, MADV_HUGEPAGE);
+#endif
+    *backing = BACKING_THP;
+    return data;
+}
+
+/*
+ * seg_alloc()
+ * Parameters: segment size in words; whether the segment holds the program
+ *             read in at startup (which gets huge pages whatever its size)
+ * Returns a newly allocated segment with word 0 set to size and all other
+ * words set to 0
+ */
+uint32_t* seg_alloc(uint32_t size, bool program)
+{
+    uint32_t *header = NULL;
+    seg_backing backing = BACKING_MALLOC;
+
+    if (huge_on && (program || size >= huge_min_words)) {
+        uint32_t *data = map_huge(map_bytes(size), &backing);
+        if (data != NULL) {
+            header = data - 1 - HEADER_WORDS;
+        }
+    }
+    if (header == NULL) {
+        backing = BACKING_MALLOC;
+        header = calloc((size_t)size + 1 + HEADER_WORDS, sizeof(*header));
+        assert(header != NULL);
+    }
+    __atomic_fetch_add(&backing_counts[backing], 1, __ATOMIC_RELAXED);
+
+    header[0] = backing;
+    uint32_t *seg = header + HEADER_WORDS;
+    seg[0] = size;
+    return seg;
+}
+
+/*
+ * seg_free()
+ * Parameters: a segment returned by seg_alloc(), or NULL
+ * Frees the segment
+ * Returns nothing
+ */
+void seg_free(uint32_t *seg)
+{
+    if (seg == NULL) {
+        return;
+    }
+
+    uint32_t *header = seg - HEADER_WORDS;
+    if (header[0] == BACKING_MALLOC) {
+        free(header);
+    } else {
+        /* Unmap the huge pages and the page below them separately */
+        char *data = (char *)(seg + 1);
+        munmap(data, map_bytes(seg[0]));
+        munmap(data - page_size, page_size);
+    }
+}
+
+/*
+ * seg_alloc_report()
+ * Parameters: stream to print to
+ * Prints how many segments were allocated with each kind of backing
+ * Returns nothing
+ */
+void seg_alloc_report(FILE *out)
+{
+    assert(out != NULL);
+    fprintf(out, "segments:      %llu hugetlbfs, %llu THP, %llu malloc\n",
+            (unsigned long long)backing_counts[BACKING_HUGETLB],
+            (unsigned long long)backing_counts[BACKING_THP],
+            (unsigned long long)backing_counts[BACKING_MALLOC]);
+}
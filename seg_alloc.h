@@ -0,0 +1,28 @@
+/*****************************************************************************
+ *
+ *    seg_alloc.h
+ *
+ *    Header file for seg_alloc module, which allocates the arrays that
+ *    represent segments, optionally backed by huge pages
+ *
+ *****************************************************************************/
+#ifndef SEG_ALLOC_H
+#define SEG_ALLOC_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * Turns on huge pages for the program read in at startup and for segments
+ * of at least min_words words
+ */
+void      seg_alloc_huge  (uint32_t min_words);
+bool      seg_alloc_huge_on(void);
+void      seg_alloc_report(FILE *out);
+
+/* Functions to allocate and free a segment (word 0 holds its size) */
+uint32_t* seg_alloc(uint32_t size, bool program);
+void      seg_free (uint32_t *seg);
+
+#endif
@@ -0,0 +1,516 @@
+/*****************************************************************************
+ *
+ *    seg_cold.c
+ *
+ *    Seg_cold module implementation for use by seg_mem.
+ *
+ *    Tracks when each segment was last loaded from or stored to, measured
+ *    in "sweeps". Every SWEEP_INTERVAL accesses a sweep looks at up to
+ *    SWEEP_BATCH more segments for one that holds at least min_words words
+ *    and has not been touched for idle_sweeps sweeps, and encodes it. The
+ *    sweeps run on the um's own thread, piggybacked on segment accesses,
+ *    so no locking is needed on the load/store path.
+ *
+ *    To keep the access that triggers a sweep cheap, a sweep encodes at
+ *    most SWEEP_WORDS words. A larger segment is encoded a piece at a time
+ *    over several sweeps, and the partial encoding is dropped if the
+ *    segment is touched in between. Encoding stops as soon as it is clear
+ *    the result would not be small enough to keep; such a segment is not
+ *    tried again until its id is remapped.
+ *
+ *    A compressed segment's slot in the mapped table holds NULL, and its
+ *    encoding is kept here instead. The next access decodes it back into a
+ *    raw segment before returning, so clients never see compressed data.
+ *
+ *    Encoding is run-length over 32-bit words, in tokens:
+ *        REPEAT_FLAG | count, value      -- count copies of value
+ *        count, word_1 ... word_count    -- count literal words
+ *    Word 0 of an encoding is the segment size, as in a raw segment, and
+ *    word 1 is the number of token words that follow.
+ *
+ *****************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include <sys/resource.h>
+
+#include "assert.h"
+#include "seg_table.h"
+#include "seg_cold.h"
+#include "seg_alloc.h"
+
+/* Constants for sweeping */
+static const uint32_t SWEEP_INTERVAL = 1 << 20;
+static const uint32_t SWEEP_BATCH    = 64;
+
+/* Words a sweep may encode: on average one per access between sweeps */
+static const uint32_t SWEEP_WORDS    = 1 << 20;
+
+/* Constants for encoding */
+static const uint32_t REPEAT_FLAG = (uint32_t)1 << 31;
+static const uint32_t MAX_RUN     = ((uint32_t)1 << 31) - 1;
+static const uint32_t MIN_REPEAT  = 3;
+
+/* Only keep an encoding that is at most this fraction (in 1/8ths) of raw */
+static const uint64_t KEEP_EIGHTHS = 6;
+
+struct cold_state {
+    uint32_t min_words;
+    uint32_t idle_sweeps;
+
+    uint32_t  capacity;      /* length of the three arrays below */
+    uint32_t *last_use;      /* sweep number of last access, per segment */
+    uint32_t **packed;       /* encoding of compressed segments, or NULL */
+    bool     *incompressible; /* encoding did not pay off last time */
+
+    uint32_t epoch;          /* number of sweeps so far */
+    uint32_t countdown;      /* accesses left until the next sweep */
+    uint32_t cursor;         /* segment the next sweep starts from */
+
+    /* Segment being encoded across sweeps (0 if none, as m[0] never is) */
+    uint32_t  pend_id;
+    uint32_t  pend_done;     /* words of it encoded so far */
+    uint32_t *pend_buf;      /* size, token length, then tokens so far */
+    uint64_t  pend_len;      /* token words in pend_buf */
+    uint64_t  pend_cap;      /* capacity of pend_buf, in words */
+
+    /* Statistics for cold_report() */
+    uint64_t compressed;
+    uint64_t rejected;
+    uint64_t thawed;
+    uint64_t words_saved;
+    uint64_t peak_words_saved;
+    uint64_t thaw_ns;
+    uint64_t max_thaw_ns;
+    uint64_t sweeps;
+    uint64_t sweep_ns;
+    uint64_t max_sweep_ns;
+};
+
+/**************************************************************************
+*                          Run-length word encoding                       *
+***************************************************************************/
+/*
+ * emit_literals()
+ * Parameters: words to copy, number of words, output buffer of limit
+ *             words, position in output buffer
+ * Returns position in output buffer after the literal tokens, or limit + 1
+ * if they do not fit
+ */
+static uint64_t emit_literals(const uint32_t *words, uint32_t n,
+                              uint32_t *out, uint64_t pos, uint64_t limit)
+{
+    while (n > 0) {
+        uint32_t chunk = n < MAX_RUN ? n : MAX_RUN;
+        if (pos + chunk + 1 > limit) {
+            return limit + 1;
+        }
+        out[pos] = chunk;
+        memcpy(out + pos + 1, words, chunk * sizeof(*words));
+        pos   += chunk + 1;
+        words += chunk;
+        n     -= chunk;
+    }
+    return pos;
+}
+
+/*
+ * rle_encode()
+ * Parameters: words to encode, number of words, output buffer of limit
+ *             words
+ * Gives up as soon as the encoding is known not to fit in limit words
+ * Returns number of words in the encoding, or limit + 1 if it does not fit
+ */
+static uint64_t rle_encode(const uint32_t *words, uint32_t n, uint32_t *out,
+                           uint64_t limit)
+{
+    uint64_t len = 0;
+    uint32_t lit_start = 0;
+    uint32_t i = 0;
+
+    while (i < n) {
+        uint32_t run = 1;
+        while (i + run < n && run < MAX_RUN && words[i + run] == words[i]) {
+            run++;
+        }
+
+        if (run >= MIN_REPEAT) {
+            len = emit_literals(words + lit_start, i - lit_start, out, len,
+                                limit);
+            if (len + 2 > limit) {
+                return limit + 1;
+            }
+            out[len]     = REPEAT_FLAG | run;
+            out[len + 1] = words[i];
+            len += 2;
+            lit_start = i + run;
+        }
+        i += run;
+    }
+
+    return emit_literals(words + lit_start, n - lit_start, out, len, limit);
+}
+
+/*
+ * rle_decode()
+ * Parameters: encoded tokens, number of decoded words expected,
+ *             output buffer of that many words
+ * Returns nothing
+ */
+static void rle_decode(const uint32_t *tokens, uint32_t n, uint32_t *out)
+{
+    uint32_t i = 0;
+    while (i < n) {
+        uint32_t count = *tokens & MAX_RUN;
+        if (*tokens & REPEAT_FLAG) {
+            uint32_t value = tokens[1];
+            for (uint32_t j = 0; j < count; j++) {
+                out[i + j] = value;
+            }
+            tokens += 2;
+        } else {
+            memcpy(out + i, tokens + 1, count * sizeof(*out));
+            tokens += count + 1;
+        }
+        i += count;
+    }
+}
+
+/**************************************************************************
+*                       Allocate/free compression state                   *
+***************************************************************************/
+/*
+ * cold_new()
+ * Parameters: smallest segment size (in words) worth compressing; number of
+ *             sweeps a segment must go untouched before it is compressed
+ * Returns: a pointer to a newly allocated cold_state
+ */
+cold_state* cold_new(uint32_t min_words, uint32_t idle_sweeps)
+{
+    cold_state *cold = calloc(1, sizeof(*cold));
+    assert(cold != NULL);
+    cold->min_words   = min_words;
+    cold->idle_sweeps = idle_sweeps;
+    cold->countdown   = SWEEP_INTERVAL;
+    cold->cursor      = 1;
+    return cold;
+}
+
+/*
+ * cold_free()
+ * Parameters: a cold_state pointer
+ * Frees the state, including encodings of any still-compressed segments
+ * Returns nothing
+ */
+void cold_free(cold_state *cold)
+{
+    assert(cold != NULL);
+    for (uint32_t i = 0; i < cold->capacity; i++) {
+        free(cold->packed[i]);
+    }
+    free(cold->packed);
+    free(cold->last_use);
+    free(cold->incompressible);
+    free(cold->pend_buf);
+    free(cold);
+}
+
+/*
+ * ensure_capacity()
+ * Parameters: a cold_state pointer, a segment id
+ * Grows the per-segment arrays so they have an entry for id; new segments
+ * count as used in the current sweep
+ * Returns nothing
+ */
+static void ensure_capacity(cold_state *cold, uint32_t id)
+{
+    if (id < cold->capacity) {
+        return;
+    }
+
+    uint64_t new_cap = (uint64_t)cold->capacity * 2;
+    if (new_cap <= id) {
+        new_cap = (uint64_t)id + 1;
+    }
+    if (new_cap > UINT32_MAX) {
+        new_cap = UINT32_MAX;
+    }
+
+    cold->last_use = realloc(cold->last_use, new_cap * sizeof(uint32_t));
+    cold->packed   = realloc(cold->packed, new_cap * sizeof(uint32_t *));
+    cold->incompressible = realloc(cold->incompressible,
+                                   new_cap * sizeof(bool));
+    assert(cold->last_use != NULL && cold->packed != NULL
+           && cold->incompressible != NULL);
+    for (uint64_t i = cold->capacity; i < new_cap; i++) {
+        cold->last_use[i]       = cold->epoch;
+        cold->packed[i]         = NULL;
+        cold->incompressible[i] = false;
+    }
+    cold->capacity = new_cap;
+}
+
+/**************************************************************************
+*                         Compress/restore segments                       *
+***************************************************************************/
+/*
+ * drop_pending()
+ * Parameters: a cold_state pointer
+ * Abandons the partial encoding of the segment being frozen, if any
+ * Returns nothing
+ */
+static void drop_pending(cold_state *cold)
+{
+    free(cold->pend_buf);
+    cold->pend_buf = NULL;
+    cold->pend_id  = 0;
+    cold->pend_len = 0;
+    cold->pend_cap = 0;
+}
+
+/*
+ * freeze_step()
+ * Parameters: a cold_state pointer, the mapped table, a word budget
+ * Encodes up to budget more words of the pending segment. Once all of it
+ * is encoded, the segment is replaced with its encoding. If the encoding
+ * grows too large to be worth keeping, it is abandoned and the segment is
+ * marked incompressible.
+ * Returns number of words of the segment used up from the budget
+ */
+static uint32_t freeze_step(cold_state *cold, seg_table *mapped,
+                            uint32_t budget)
+{
+    uint32_t id   = cold->pend_id;
+    uint32_t *seg = table_get(mapped, id);
+    uint32_t size = seg[0];
+
+    uint32_t n = size - cold->pend_done;
+    if (n > budget) {
+        n = budget;
+    }
+
+    /*
+     * n words never take more than n + 1 token words (n < MAX_RUN), so
+     * only an encoding that would pass the keep limit can overflow room
+     */
+    uint64_t keep  = (uint64_t)size * KEEP_EIGHTHS / 8;
+    uint64_t room  = keep - cold->pend_len;
+    uint64_t limit = (uint64_t)n + 1 < room ? (uint64_t)n + 1 : room;
+
+    uint64_t need = 2 + cold->pend_len + limit;
+    if (need > cold->pend_cap) {
+        uint64_t new_cap = cold->pend_cap * 2;
+        cold->pend_cap = new_cap > need ? new_cap : need;
+        cold->pend_buf = realloc(cold->pend_buf,
+                                 cold->pend_cap * sizeof(uint32_t));
+        assert(cold->pend_buf != NULL);
+    }
+
+    uint64_t len = rle_encode(seg + 1 + cold->pend_done, n,
+                              cold->pend_buf + 2 + cold->pend_len, limit);
+    if (len > limit) {
+        cold->incompressible[id] = true;
+        cold->rejected++;
+        drop_pending(cold);
+        return n;
+    }
+    cold->pend_len  += len;
+    cold->pend_done += n;
+    if (cold->pend_done < size) {
+        return n;
+    }
+
+    /* Done: trim the buffer and make it the segment's encoding */
+    uint32_t *packed = realloc(cold->pend_buf,
+                               (cold->pend_len + 2) * sizeof(*packed));
+    assert(packed != NULL);
+    packed[0] = size;
+    packed[1] = cold->pend_len;
+
+    cold->packed[id] = packed;
+    table_put(mapped, id, NULL);
+    seg_free(seg);
+
+    cold->compressed++;
+    cold->words_saved += size - cold->pend_len;
+    if (cold->words_saved > cold->peak_words_saved) {
+        cold->peak_words_saved = cold->words_saved;
+    }
+    cold->pend_buf = NULL;
+    drop_pending(cold);
+    return n;
+}
+
+/*
+ * thaw()
+ * Parameters: a cold_state pointer, the mapped table, a segment id
+ * Decodes compressed segment id back into a raw segment
+ * Returns the raw segment
+ */
+static uint32_t *thaw(cold_state *cold, seg_table *mapped, uint32_t id)
+{
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    uint32_t *packed = cold->packed[id];
+    assert(packed != NULL);
+    uint32_t size = packed[0];
+
+    uint32_t *seg = seg_alloc(size, false);
+    rle_decode(packed + 2, size, seg + 1);
+
+    cold->words_saved -= size - packed[1];
+    free(packed);
+    cold->packed[id] = NULL;
+    table_put(mapped, id, seg);
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    uint64_t ns = (end.tv_sec - start.tv_sec) * 1000000000ull
+                  + end.tv_nsec - start.tv_nsec;
+    cold->thawed++;
+    cold->thaw_ns += ns;
+    if (ns > cold->max_thaw_ns) {
+        cold->max_thaw_ns = ns;
+    }
+
+    return seg;
+}
+
+/*
+ * sweep()
+ * Parameters: a cold_state pointer, the mapped table
+ * Starts a new sweep, which encodes at most SWEEP_WORDS words: first of
+ * the segment left pending by the last sweep, then of cold, large
+ * segments found among the next SWEEP_BATCH segments (m[0] is never
+ * compressed)
+ * Returns nothing
+ */
+static void sweep(cold_state *cold, seg_table *mapped)
+{
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    cold->epoch++;
+    uint32_t len = table_length(mapped);
+    if (len > 1) {
+        ensure_capacity(cold, len - 1);
+    }
+
+    uint32_t budget = SWEEP_WORDS;
+    uint32_t looked = 0;
+    while (budget > 0) {
+        if (cold->pend_id == 0) {
+            if (looked == SWEEP_BATCH || len <= 1 || looked == len - 1) {
+                break;
+            }
+            looked++;
+            if (cold->cursor >= len) {
+                cold->cursor = 1;
+            }
+            uint32_t id = cold->cursor++;
+
+            uint32_t *seg = table_get(mapped, id);
+            if (seg == NULL || seg[0] < cold->min_words
+                || cold->incompressible[id]
+                || cold->epoch - cold->last_use[id] < cold->idle_sweeps) {
+                continue;
+            }
+            cold->pend_id   = id;
+            cold->pend_done = 0;
+        }
+        budget -= freeze_step(cold, mapped, budget);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    uint64_t ns = (end.tv_sec - start.tv_sec) * 1000000000ull
+                  + end.tv_nsec - start.tv_nsec;
+    cold->sweeps++;
+    cold->sweep_ns += ns;
+    if (ns > cold->max_sweep_ns) {
+        cold->max_sweep_ns = ns;
+    }
+}
+
+/*
+ * cold_access()
+ * Parameters: a cold_state pointer, the mapped table, a segment id
+ * Runs a sweep when one is due, then marks segment id as used,
+ * decompressing it first if needed. The sweep goes first so that it can
+ * never free the segment handed back to the caller.
+ * Returns the raw segment
+ */
+uint32_t* cold_access(cold_state *cold, seg_table *mapped, uint32_t id)
+{
+    if (--cold->countdown == 0) {
+        cold->countdown = SWEEP_INTERVAL;
+        sweep(cold, mapped);
+    }
+
+    ensure_capacity(cold, id);
+    if (id == cold->pend_id && id != 0) {
+        drop_pending(cold);
+    }
+    uint32_t *seg = table_get(mapped, id);
+    if (seg == NULL) {
+        seg = thaw(cold, mapped, id);
+    }
+    cold->last_use[id] = cold->epoch;
+    return seg;
+}
+
+/*
+ * cold_reset()
+ * Parameters: a cold_state pointer, a segment id
+ * Drops any encoding held for segment id (called when id is remapped)
+ * and marks it as used and worth trying to compress again
+ * Returns nothing
+ */
+void cold_reset(cold_state *cold, uint32_t id)
+{
+    ensure_capacity(cold, id);
+    if (id == cold->pend_id) {
+        drop_pending(cold);
+    }
+    cold->incompressible[id] = false;
+    if (cold->packed[id] != NULL) {
+        uint32_t *packed = cold->packed[id];
+        cold->words_saved -= packed[0] - packed[1];
+        free(packed);
+        cold->packed[id] = NULL;
+    }
+    cold->last_use[id] = cold->epoch;
+}
+
+/*
+ * cold_report()
+ * Parameters: a cold_state pointer, stream to print to
+ * Prints how much compression saved and what sweeps and decompression
+ * cost, along with the peak resident set size of the process
+ * Returns nothing
+ */
+void cold_report(cold_state *cold, FILE *out)
+{
+    assert(cold != NULL && out != NULL);
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+
+    fprintf(out, "cold segments: %llu compressed, %llu decompressed, "
+            "%llu not worth compressing\n",
+            (unsigned long long)cold->compressed,
+            (unsigned long long)cold->thawed,
+            (unsigned long long)cold->rejected);
+    fprintf(out, "memory saved:  %llu KiB now, %llu KiB peak\n",
+            (unsigned long long)(cold->words_saved * 4 / 1024),
+            (unsigned long long)(cold->peak_words_saved * 4 / 1024));
+    fprintf(out, "sweeps:        %llu, %.1f us mean, %.1f us max\n",
+            (unsigned long long)cold->sweeps,
+            cold->sweeps ? cold->sweep_ns / 1e3 / cold->sweeps : 0.0,
+            cold->max_sweep_ns / 1e3);
+    fprintf(out, "decompression: %.1f us mean, %.1f us max\n",
+            cold->thawed ? cold->thaw_ns / 1e3 / cold->thawed : 0.0,
+            cold->max_thaw_ns / 1e3);
+    fprintf(out, "peak RSS:      %ld KiB\n", usage.ru_maxrss);
+}
@@ -0,0 +1,29 @@
+/*****************************************************************************
+ *
+ *    seg_cold.h
+ *
+ *    Header file for seg_cold module, which compresses large segments that
+ *    have not been touched for a while and restores them on next access
+ *
+ *****************************************************************************/
+#ifndef SEG_COLD_H
+#define SEG_COLD_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include "seg_table.h"
+
+typedef struct cold_state cold_state;
+
+/* Functions to allocate and free the compression state */
+cold_state* cold_new (uint32_t min_words, uint32_t idle_sweeps);
+void        cold_free(cold_state *cold);
+
+/* Functions called by seg_mem on segment access and (re)mapping */
+uint32_t*   cold_access(cold_state *cold, seg_table *mapped, uint32_t id);
+void        cold_reset (cold_state *cold, uint32_t id);
+
+/* Prints compression and memory statistics */
+void        cold_report(cold_state *cold, FILE *out);
+
+#endif
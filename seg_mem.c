@@ -14,17 +14,25 @@
 #include <stdlib.h>
 #include <stdint.h>
 #include <stdbool.h>
+#include <string.h>
+#include <sys/stat.h>
 
 #include "assert.h"
-#include "seq.h"
 #include "seg_mem.h"
-#include "bitpack.h"
+#include "seg_table.h"
+#include "seg_cold.h"
+#include "prog_image.h"
+#include "seg_alloc.h"
+#include "bits.h"
 
 
 /* Constants for memory mmapping */
 static const uint32_t MAX_SEGMENTS = ~0;
 static const uint32_t SEGS = 500;
 
+/* Initial buffer size for reading a program of unknown size */
+static const size_t PROG_BUF_SIZE = 1 << 16;
+
 /**************************************************************************
 *                Allocate/initialize/free segmented memory                *
 ***************************************************************************/
@@ -37,11 +45,68 @@ seg_mem_obj* seg_mem_new()
 {
     seg_mem_obj *new_seg_mem = malloc(sizeof(seg_mem_obj));
     assert(new_seg_mem != NULL);
-    new_seg_mem->mapped = Seq_new(SEGS);
-    new_seg_mem->unmapped = Seq_new(SEGS);
+    table_init(&new_seg_mem->mapped, SEGS);
+    new_seg_mem->cold = NULL;
+    image_init(&new_seg_mem->image);
     return new_seg_mem;
 }
 
+/*
+ * free_segment()
+ * Parameters: a seg_mem_obj pointer, a segment
+ * Frees the segment, or unmaps it if it lives in a cached program image
+ * Returns nothing
+ */
+static void free_segment(seg_mem_obj *mem, uint32_t *segment)
+{
+    if (image_owns(&mem->image, segment)) {
+        image_release(&mem->image);
+    } else {
+        seg_free(segment);
+    }
+}
+
+/*
+ * seg_mem_compress_cold()
+ * Parameters: a seg_mem_obj pointer; smallest segment size (in words) to
+ *             compress; number of sweeps a segment must go unused first
+ * Turns on compression of large, rarely used segments
+ * Returns nothing
+ */
+void seg_mem_compress_cold(seg_mem_obj *mem, uint32_t min_words,
+                           uint32_t idle_sweeps)
+{
+    assert(mem != NULL && mem->cold == NULL);
+    mem->cold = cold_new(min_words, idle_sweeps);
+}
+
+/*
+ * seg_mem_report()
+ * Parameters: a seg_mem_obj pointer, stream to print to
+ * Prints cold segment compression statistics, if compression is on
+ * Returns nothing
+ */
+void seg_mem_report(seg_mem_obj *mem, FILE *out)
+{
+    assert(mem != NULL);
+    if (mem->cold != NULL) {
+        cold_report(mem->cold, out);
+    }
+}
+
+/*
+ * get_segment()
+ * Parameters: a seg_mem_obj pointer, a segment id
+ * Returns the raw segment m[id], decompressing it first if it is cold
+ */
+static inline uint32_t *get_segment(seg_mem_obj *mem, uint32_t id)
+{
+    if (mem->cold != NULL) {
+        return cold_access(mem->cold, &mem->mapped, id);
+    }
+    return table_get(&mem->mapped, id);
+}
+
 /*
  * seg_mem_free()
  * Parameters: a seg_mem_obj pointer
@@ -51,87 +116,94 @@ seg_mem_obj* seg_mem_new()
 void seg_mem_free(seg_mem_obj* mem)
 {
     assert(mem != NULL);
-    int unmapped_len = Seq_length(mem->unmapped);
-    int mapped_len = Seq_length(mem->mapped);
+    uint32_t mapped_len = table_length(&mem->mapped);
 
     /* Free mapped segments */
-    for (int i = 0; i < mapped_len; i++) {
-        uint32_t *curr = Seq_remlo(mem->mapped);
-        free(curr);
-        curr = NULL;
+    for (uint32_t i = 0; i < mapped_len; i++) {
+        free_segment(mem, table_get(&mem->mapped, i));
     }
+    image_release(&mem->image);
 
-    /* Free unmapped segment ids */
-    for (int i = 0; i < unmapped_len; i++) {
-        uint32_t *curr = Seq_remlo(mem->unmapped);
-        free(curr);
-        curr = NULL;
+    /* Free encodings of segments that are still compressed */
+    if (mem->cold != NULL) {
+        cold_free(mem->cold);
     }
 
-    /* Free the sequences themselves, then the pointer to the object */
-    Seq_free(&(mem->mapped));
-    Seq_free(&(mem->unmapped));
+    /* Free the table, then the pointer to the object */
+    table_free(&mem->mapped);
     free(mem);
 }
 
+/*
+ * read_prog()
+ * Parameters: FILE * to file containing um program
+ * Reads the whole program file into a buffer in one go and decodes its
+ * big-endian words straight into a segment (a partial word at the end of
+ * the file is dropped)
+ * Returns a newly allocated segment holding the instructions
+ */
+static uint32_t *read_prog(FILE *prog)
+{
+    /* Start with room for the whole file if we can tell its size */
+    size_t cap = PROG_BUF_SIZE;
+    struct stat st;
+    if (fstat(fileno(prog), &st) == 0 && S_ISREG(st.st_mode)
+        && (size_t)st.st_size >= cap) {
+        cap = (size_t)st.st_size + 1;
+    }
+    unsigned char *bytes = malloc(cap);
+    assert(bytes != NULL);
+
+    size_t len = 0;
+    size_t nread;
+    while ((nread = fread(bytes + len, 1, cap - len, prog)) > 0) {
+        len += nread;
+        if (len == cap) {
+            cap *= 2;
+            bytes = realloc(bytes, cap);
+            assert(bytes != NULL);
+        }
+    }
+    assert(!ferror(prog));
+    assert(len / 4 <= UINT32_MAX);
+
+    /* Array[0] is the size of the segment, or total number of instructions */
+    uint32_t nwords = len / 4;
+    uint32_t *mem_seg = seg_alloc(nwords, true);
+    for (uint32_t i = 0; i < nwords; i++) {
+        const unsigned char *word = bytes + (size_t)i * 4;
+        mem_seg[i + 1] = (uint32_t)word[0] << 24 | (uint32_t)word[1] << 16
+                         | (uint32_t)word[2] << 8 | word[3];
+    }
+
+    free(bytes);
+    return mem_seg;
+}
+
 /*
  * init_prog()
  * Parameters: a seg_mem_obj pointer, FILE * to file containing um program
- * Reads in all instructions in program file and stores in m[0]
+ * Stores all instructions in program file in m[0], using the cached
+ * image of the program when there is one (and caching it otherwise)
  * Returns nothing
  */
 void init_prog(seg_mem_obj *mem, FILE *prog)
 {
     assert(mem != NULL && prog != NULL);
-    /* Read in file instructions to a sequence that can expand to fit them */
-    Seq_T instructions = Seq_new(SEGS);
-    int curr = 0;
-    while (! feof(prog)){
-        uint32_t *prog_bits = malloc(sizeof(*prog_bits));
-        assert(prog_bits != NULL);
-        *prog_bits = 0;
-        
-         for (int i = 3; i >= 0; i--){
-            curr = fgetc(prog);
-            if (curr == EOF) {
-                free(prog_bits);
-                break;
-            }
-            *prog_bits = Bitpack_newu(*prog_bits, 8, i * 8, curr);
-        }
-        if (curr == EOF) {
-            break;
-        }
-        Seq_addhi(instructions, prog_bits);
-    }
-
-    /* Get number of instructions read in */
-    int len = Seq_length(instructions);
-
-    /* Create memory segment (array) to hold program instructions */
-    /* Array[0] is the size of the segment, or total number of instructions */
-    uint32_t *mem_seg = malloc((len + 1) * sizeof(*mem_seg));
-    assert(mem_seg != NULL);
-    mem_seg[0] = len;
-    for (int i = 1; i <= len; i++) {
-        uint32_t *curr = Seq_remlo(instructions);
-        mem_seg[i] = *curr;
-        free(curr);
+    uint32_t *mem_seg = image_load(&mem->image, prog);
+    if (mem_seg == NULL) {
+        mem_seg = read_prog(prog);
+        image_store(&mem->image, mem_seg);
+    } else if (seg_alloc_huge_on()) {
+        /* Copy the cached image into huge pages */
+        uint32_t *huge_seg = seg_alloc(mem_seg[0], true);
+        memcpy(huge_seg + 1, mem_seg + 1, mem_seg[0] * sizeof(*mem_seg));
+        image_release(&mem->image);
+        mem_seg = huge_seg;
     }
 
     /* Insert instructions array into m[0] segment */
-    Seq_addlo(mem->mapped, mem_seg);
-
-    /* Add indices 1 - 499 to sequence storing unmapped segment ids */
-    for (unsigned i = 1; i < SEGS; i++) {
-        uint32_t *curr_index = malloc(sizeof(*curr_index));
-        assert(curr_index != NULL);
-        *curr_index = i;
-        Seq_addhi(mem->unmapped, curr_index);
-    }
-    
-    /* Free the placeholder instruction sequence */
-    Seq_free(&instructions);
+    table_addhi(&mem->mapped, mem_seg);
 }
 
 /**************************************************************************
@@ -146,47 +218,33 @@ void init_prog(seg_mem_obj *mem, FILE *prog)
 uint32_t seg_map(seg_mem_obj *mem, uint32_t size)
 {
     assert(mem != NULL);
-    assert((uint32_t)Seq_length(mem->mapped) < MAX_SEGMENTS);
-
-    /* Increase number of unmapped ids by SEGS if client has used them all */
-    if (Seq_length(mem->unmapped) == 0) {
-        unsigned int start = Seq_length(mem->mapped);
-        for (unsigned i = start; i < start + SEGS; i++) {
-            uint32_t *curr_index = malloc(sizeof(*curr_index));
-            assert(curr_index != NULL);
-            *curr_index = i;
-            Seq_addhi(mem->unmapped, curr_index);
-        }
-    }
+    assert(table_length(&mem->mapped) < MAX_SEGMENTS);
 
     /* 
      * Create array of size + 1 words to represent segment
-     * store size in array[0] and init all other values in array to 0
+     * seg_alloc() stores size in array[0] and inits all other values to 0
      */
-    uint32_t *map_seg = malloc((size + 1) * sizeof(*map_seg));
-    assert(map_seg != NULL);
-    map_seg[0] = size;
-    for (unsigned i = 1; i <= size; i++) {
-        map_seg[i] = 0;
-    }
+    uint32_t *map_seg = seg_alloc(size, false);
+
+    /* Reuse the id of the last segment unmapped, else take a new id */
+    uint32_t seg_id = table_next_id(&mem->mapped);
 
-    /* get the id of an unmapped segment */
-    uint32_t *new_segment = Seq_remlo(mem->unmapped);
-    uint32_t seg_id = *new_segment;
+    /* Forget any compressed copy of the segment previously at this id */
+    if (mem->cold != NULL) {
+        cold_reset(mem->cold, seg_id);
+    }
 
     /*
-     * Either add new segment to high end of mapped sequence if its larger
-     * than the max index; else put it at a particular index in the sequence
+     * Either add new segment to high end of mapped table if its id is new;
+     * else put it at a particular index in the table
      */
-    if (seg_id >= (uint32_t)Seq_length(mem->mapped)) {
-        Seq_addhi(mem->mapped, map_seg);
+    if (seg_id == table_length(&mem->mapped)) {
+        table_addhi(&mem->mapped, map_seg);
     } else {
-        uint32_t *old_seg = Seq_put(mem->mapped, seg_id, map_seg);
-        free(old_seg);
+        uint32_t *old_seg = table_put(&mem->mapped, seg_id, map_seg);
+        seg_free(old_seg);
     }
 
-    free(new_segment);
-
     /* Return id that identifies the mapped segment */
     return seg_id;
 }
@@ -200,10 +258,7 @@ uint32_t seg_map(seg_mem_obj *mem, uint32_t size)
 void seg_unmap(seg_mem_obj *mem, uint32_t seg_id)
 {
     assert(mem != NULL);
-    uint32_t *index = malloc(sizeof(*index));
-    assert(index != NULL);
-    *index = seg_id;
-    Seq_addlo(mem->unmapped, index);
+    table_release_id(&mem->mapped, seg_id);
 }
 
 /*
@@ -216,7 +271,7 @@ uint32_t seg_load(seg_mem_obj *mem, uint32_t b, uint32_t c)
     assert(mem != NULL);
 
     /* Add one to c because m[b][0] holds size of the segment */
-    return ((uint32_t *)Seq_get(mem->mapped, b))[c + 1];
+    return get_segment(mem, b)[c + 1];
 }
 
 /*
@@ -228,7 +283,7 @@ uint32_t seg_load(seg_mem_obj *mem, uint32_t b, uint32_t c)
 void seg_store(seg_mem_obj *mem, uint32_t a, uint32_t b, uint32_t c)
 {
     assert(mem != NULL);
-    uint32_t *segment = Seq_get(mem->mapped, a);
+    uint32_t *segment = get_segment(mem, a);
 
     /* Again, add one to segment offset because first index is the size */
     segment[b + 1] = c;
@@ -249,24 +304,25 @@ void seg_load_prog(seg_mem_obj *mem, uint32_t b)
         return;
     }
 
-    /* Allocate size of segment m[b] to store duplicated segment */
-    uint32_t seglen = ((uint32_t *)Seq_get(mem->mapped, b))[0];
-    uint32_t *duplicate = malloc((seglen + 1) * sizeof(*duplicate));
-    assert(duplicate != NULL);
+    /*
+     * Allocate size of segment m[b] to store duplicated segment. Like any
+     * other segment it only gets huge pages if it is large: programs that
+     * load program from a small segment in a loop would otherwise map a
+     * fresh 2 MiB region on every jump
+     */
+    uint32_t *segment = get_segment(mem, b);
+    uint32_t seglen = segment[0];
+    uint32_t *duplicate = seg_alloc(seglen, false);
 
     /* Copy over values into duplicate segment */
-    duplicate[0] = seglen;
     for (unsigned i = 1; i <= seglen; i++) {
-        duplicate[i] = ((uint32_t *)Seq_get(mem->mapped, b))[i];
+        duplicate[i] = segment[i];
     }
 
-    /* Free current 0 segment */
-    uint32_t *currprog = Seq_remlo(mem->mapped);
-    free(currprog);
+    /* Put duplicated memory segment in m[0], then free old 0 segment */
+    uint32_t *currprog = table_put(&mem->mapped, 0, duplicate);
+    free_segment(mem, currprog);
     currprog = NULL;
-
-    /* Put duplicated memory segment in m[0] */
-    Seq_addlo(mem->mapped, duplicate);
 }
 
 /***************************************************************************
@@ -280,16 +336,17 @@ void seg_load_prog(seg_mem_obj *mem, uint32_t b)
 uint32_t program_size(seg_mem_obj* mem)
 {
     assert(mem != NULL);
-    return ((uint32_t *)Seq_get(mem->mapped, 0))[0];
+    return table_get(&mem->mapped, 0)[0];
 }
 
 /*
  * get_prog_instruction()
  * Parameters: pointer to a seg_mem_obj; uint32_t prog_ctr
  * Returns the word at m[0][prog_ctr]
+ * m[0] is never compressed, so this skips the cold segment bookkeeping
  */
 uint32_t get_prog_instruction(seg_mem_obj* mem, uint32_t prog_ctr)
 {
     assert(mem != NULL);
-    return seg_load(mem, 0, prog_ctr);
+    return table_get(&mem->mapped, 0)[prog_ctr + 1];
 }
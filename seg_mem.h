@@ -11,12 +11,16 @@
 #ifndef SEG_MEM_H
 #define SEG_MEM_H
 
+#include <stdio.h>
 #include <stdint.h>
-#include "seq.h"
+#include "seg_table.h"
+#include "seg_cold.h"
+#include "prog_image.h"
 
 typedef struct seg_mem_obj {
-	Seq_T mapped;
-	Seq_T unmapped;
+	seg_table mapped;	/* also holds the ids of unmapped segments */
+	cold_state *cold;	/* NULL unless cold segments are compressed */
+	prog_image image;	/* cached image m[0] was loaded from, if any */
 } seg_mem_obj;
 
 /* Functions to allocate, initialize, and free segmented memory */
@@ -24,6 +28,11 @@ seg_mem_obj* seg_mem_new();
 void init_prog(seg_mem_obj *obj, FILE *prog);
 void seg_mem_free(seg_mem_obj *obj);
 
+/* Functions for optional compression of cold segments (see seg_cold.h) */
+void seg_mem_compress_cold(seg_mem_obj *obj, uint32_t min_words,
+                           uint32_t idle_sweeps);
+void seg_mem_report(seg_mem_obj *obj, FILE *out);
+
 /* Functions used by the um to iterate through program instructions */
 uint32_t program_size(seg_mem_obj* mem);
 uint32_t get_prog_instruction(seg_mem_obj* mem, uint32_t prog_ctr);
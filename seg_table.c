@@ -0,0 +1,96 @@
+/*****************************************************************************
+ *
+ *    seg_table.c
+ *
+ *    Seg_table module implementation for use by seg_mem and seg_cold.
+ *    Defines the functions that allocate, grow, and free a table; the
+ *    accessors are inline in seg_table.h.
+ *
+ *****************************************************************************/
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "assert.h"
+#include "seg_table.h"
+
+/*
+ * table_init()
+ * Parameters: a seg_table pointer, number of segments to make room for
+ * Sets up an empty table
+ * Returns nothing
+ */
+void table_init(seg_table *table, uint32_t hint)
+{
+    assert(table != NULL && hint > 0);
+    table->segs = malloc(hint * sizeof(*table->segs));
+    assert(table->segs != NULL);
+    table->length   = 0;
+    table->capacity = hint;
+
+    table->free_ids = malloc(hint * sizeof(*table->free_ids));
+    assert(table->free_ids != NULL);
+    table->nfree         = 0;
+    table->free_capacity = hint;
+}
+
+/*
+ * table_addhi()
+ * Parameters: a seg_table pointer, a segment
+ * Adds seg at the end of the table (with id table_length() - 1),
+ * doubling the table's capacity when it is full
+ * Returns nothing
+ */
+void table_addhi(seg_table *table, uint32_t *seg)
+{
+    assert(table != NULL);
+    if (table->length == table->capacity) {
+        assert(table->capacity < UINT32_MAX);
+        uint64_t new_cap = (uint64_t)table->capacity * 2;
+        if (new_cap > UINT32_MAX) {
+            new_cap = UINT32_MAX;
+        }
+        table->segs = realloc(table->segs, new_cap * sizeof(*table->segs));
+        assert(table->segs != NULL);
+        table->capacity = new_cap;
+    }
+    table->segs[table->length++] = seg;
+}
+
+/*
+ * table_grow_free()
+ * Parameters: a seg_table pointer
+ * Doubles the room for ids of unmapped segments
+ * Returns nothing
+ */
+void table_grow_free(seg_table *table)
+{
+    assert(table != NULL && table->free_capacity < UINT32_MAX);
+    uint64_t new_cap = (uint64_t)table->free_capacity * 2;
+    if (new_cap > UINT32_MAX) {
+        new_cap = UINT32_MAX;
+    }
+    table->free_ids = realloc(table->free_ids,
+                              new_cap * sizeof(*table->free_ids));
+    assert(table->free_ids != NULL);
+    table->free_capacity = new_cap;
+}
+
+/*
+ * table_free()
+ * Parameters: a seg_table pointer
+ * Frees the table itself and its free ids (not the segments in it)
+ * Returns nothing
+ */
+void table_free(seg_table *table)
+{
+    assert(table != NULL);
+    free(table->segs);
+    table->segs     = NULL;
+    table->length   = 0;
+    table->capacity = 0;
+
+    free(table->free_ids);
+    table->free_ids      = NULL;
+    table->nfree         = 0;
+    table->free_capacity = 0;
+}
@@ -0,0 +1,90 @@
+/*****************************************************************************
+ *
+ *    seg_table.h
+ *
+ *    Header file for seg_table module, the growable array of segments
+ *    indexed by segment id, together with a stack of the ids of unmapped
+ *    segments for reuse. The accessors are defined here, inline, because
+ *    they sit on the path of every segmented load, store, map and unmap.
+ *
+ *****************************************************************************/
+#ifndef SEG_TABLE_H
+#define SEG_TABLE_H
+
+#include <stdint.h>
+#include "assert.h"
+
+typedef struct seg_table {
+    uint32_t **segs;
+    uint32_t length;
+    uint32_t capacity;
+    uint32_t *free_ids;     /* ids of unmapped segments, last in on top */
+    uint32_t nfree;
+    uint32_t free_capacity;
+} seg_table;
+
+/* Functions to initialize, grow, and free a table */
+void table_init     (seg_table *table, uint32_t hint);
+void table_addhi    (seg_table *table, uint32_t *seg);
+void table_grow_free(seg_table *table);
+void table_free     (seg_table *table);
+
+/*
+ * table_length()
+ * Returns the number of segment ids in the table
+ */
+static inline uint32_t table_length(seg_table *table)
+{
+    return table->length;
+}
+
+/*
+ * table_get()
+ * Returns the segment with id i (it is a CRE for i to be out of range)
+ */
+static inline uint32_t *table_get(seg_table *table, uint32_t i)
+{
+    assert(i < table->length);
+    return table->segs[i];
+}
+
+/*
+ * table_put()
+ * Replaces the segment with id i by seg
+ * Returns the segment previously at id i
+ */
+static inline uint32_t *table_put(seg_table *table, uint32_t i, uint32_t *seg)
+{
+    assert(i < table->length);
+    uint32_t *old = table->segs[i];
+    table->segs[i] = seg;
+    return old;
+}
+
+/*
+ * table_next_id()
+ * Returns the id most recently passed to table_release_id(), or
+ * table_length() if there is none (a segment with that id is then added
+ * with table_addhi())
+ */
+static inline uint32_t table_next_id(seg_table *table)
+{
+    if (table->nfree > 0) {
+        return table->free_ids[--table->nfree];
+    }
+    return table->length;
+}
+
+/*
+ * table_release_id()
+ * Makes segment id i available to table_next_id()
+ */
+static inline void table_release_id(seg_table *table, uint32_t i)
+{
+    if (table->nfree == table->free_capacity) {
+        table_grow_free(table);
+    }
+    table->free_ids[table->nfree++] = i;
+}
+
+#endif
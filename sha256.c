@@ -0,0 +1,176 @@
+/*****************************************************************************
+ *
+ *    sha256.c
+ *
+ *    Sha256 module implementation for use by prog_image.
+ *
+ *    A plain, portable SHA-256 as specified in FIPS 180-4: the input is
+ *    processed in 64-byte blocks, and the last block is padded with a 1
+ *    bit, zeros and the message length in bits.
+ *
+ *****************************************************************************/
+#include <stdint.h>
+#include <string.h>
+
+#include "assert.h"
+#include "sha256.h"
+
+/* Round constants: first 32 bits of the cube roots of the first 64 primes */
+static const uint32_t K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1,
+    0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+    0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786,
+    0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147,
+    0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+    0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b,
+    0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a,
+    0x5b9cca4f, 0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+    0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+/* Initial state: first 32 bits of the square roots of the first 8 primes */
+static const uint32_t H0[8] = {
+    0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+    0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+};
+
+/*
+ * rotr()
+ * Returns x rotated right by n bits (0 < n < 32)
+ */
+static inline uint32_t rotr(uint32_t x, unsigned n)
+{
+    return (x >> n) | (x << (32 - n));
+}
+
+/*
+ * compress()
+ * Parameters: a sha256_ctx pointer, one 64-byte block
+ * Mixes the block into the hash state
+ * Returns nothing
+ */
+static void compress(sha256_ctx *ctx, const unsigned char *block)
+{
+    uint32_t w[64];
+    for (int i = 0; i < 16; i++) {
+        const unsigned char *b = block + i * 4;
+        w[i] = (uint32_t)b[0] << 24 | (uint32_t)b[1] << 16
+               | (uint32_t)b[2] << 8 | b[3];
+    }
+    for (int i = 16; i < 64; i++) {
+        uint32_t s0 = rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18)
+                      ^ (w[i - 15] >> 3);
+        uint32_t s1 = rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19)
+                      ^ (w[i - 2] >> 10);
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+
+    uint32_t a = ctx->state[0], b = ctx->state[1], c = ctx->state[2],
+             d = ctx->state[3], e = ctx->state[4], f = ctx->state[5],
+             g = ctx->state[6], h = ctx->state[7];
+    for (int i = 0; i < 64; i++) {
+        uint32_t s1 = rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25);
+        uint32_t ch = (e & f) ^ (~e & g);
+        uint32_t t1 = h + s1 + ch + K[i] + w[i];
+        uint32_t s0 = rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22);
+        uint32_t maj = (a & b) ^ (a & c) ^ (b & c);
+        uint32_t t2 = s0 + maj;
+        h = g;
+        g = f;
+        f = e;
+        e = d + t1;
+        d = c;
+        c = b;
+        b = a;
+        a = t1 + t2;
+    }
+
+    ctx->state[0] += a;
+    ctx->state[1] += b;
+    ctx->state[2] += c;
+    ctx->state[3] += d;
+    ctx->state[4] += e;
+    ctx->state[5] += f;
+    ctx->state[6] += g;
+    ctx->state[7] += h;
+}
+
+/*
+ * sha256_init()
+ * Parameters: a sha256_ctx pointer
+ * Starts a new hash
+ * Returns nothing
+ */
+void sha256_init(sha256_ctx *ctx)
+{
+    assert(ctx != NULL);
+    memcpy(ctx->state, H0, sizeof(H0));
+    ctx->length = 0;
+    ctx->fill   = 0;
+}
+
+/*
+ * sha256_update()
+ * Parameters: a sha256_ctx pointer, bytes to hash, number of bytes
+ * Adds the bytes to the hash
+ * Returns nothing
+ */
+void sha256_update(sha256_ctx *ctx, const void *bytes, size_t len)
+{
+    assert(ctx != NULL && (bytes != NULL || len == 0));
+    const unsigned char *p = bytes;
+    ctx->length += len;
+
+    /* Top up a partial block first */
+    if (ctx->fill > 0) {
+        size_t take = 64 - ctx->fill < len ? 64 - ctx->fill : len;
+        memcpy(ctx->block + ctx->fill, p, take);
+        ctx->fill += take;
+        p   += take;
+        len -= take;
+        if (ctx->fill < 64) {
+            return;
+        }
+        compress(ctx, ctx->block);
+        ctx->fill = 0;
+    }
+
+    for (; len >= 64; p += 64, len -= 64) {
+        compress(ctx, p);
+    }
+    memcpy(ctx->block, p, len);
+    ctx->fill = len;
+}
+
+/*
+ * sha256_final()
+ * Parameters: a sha256_ctx pointer, buffer for the digest
+ * Pads the message, finishes the hash and writes the digest
+ * Returns nothing
+ */
+void sha256_final(sha256_ctx *ctx, unsigned char digest[SHA256_BYTES])
+{
+    assert(ctx != NULL && digest != NULL);
+    uint64_t bits = ctx->length * 8;
+
+    ctx->block[ctx->fill++] = 0x80;
+    if (ctx->fill > 56) {
+        memset(ctx->block + ctx->fill, 0, 64 - ctx->fill);
+        compress(ctx, ctx->block);
+        ctx->fill = 0;
+    }
+    memset(ctx->block + ctx->fill, 0, 56 - ctx->fill);
+    for (int i = 0; i < 8; i++) {
+        ctx->block[56 + i] = bits >> (56 - i * 8);
+    }
+    compress(ctx, ctx->block);
+
+    for (int i = 0; i < 8; i++) {
+        digest[i * 4]     = ctx->state[i] >> 24;
+        digest[i * 4 + 1] = ctx->state[i] >> 16;
+        digest[i * 4 + 2] = ctx->state[i] >> 8;
+        digest[i * 4 + 3] = ctx->state[i];
+    }
+}
@@ -0,0 +1,30 @@
+/*****************************************************************************
+ *
+ *    sha256.h
+ *
+ *    Header file for sha256 module, a small SHA-256 (FIPS 180-4)
+ *    implementation used to name and check cached program images
+ *
+ *****************************************************************************/
+#ifndef SHA256_H
+#define SHA256_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* Number of bytes in a digest */
+#define SHA256_BYTES 32
+
+typedef struct sha256_ctx {
+    uint32_t state[8];
+    uint64_t length;            /* bytes hashed so far */
+    unsigned char block[64];    /* partial block waiting for more input */
+    size_t fill;                /* bytes in block */
+} sha256_ctx;
+
+/* Functions to hash a stream of bytes */
+void sha256_init  (sha256_ctx *ctx);
+void sha256_update(sha256_ctx *ctx, const void *bytes, size_t len);
+void sha256_final (sha256_ctx *ctx, unsigned char digest[SHA256_BYTES]);
+
+#endif
@@ -0,0 +1,108 @@
+/*****************************************************************************
+ *
+ *    tlb_perf.c
+ *
+ *    Tlb_perf module implementation. Opens one hardware cache counter for
+ *    dTLB read misses and one for iTLB read misses on the calling thread,
+ *    counting user-space events only (so it works with the default
+ *    perf_event_paranoid setting). Counters the kernel or CPU does not
+ *    support are reported as unavailable.
+ *
+ *****************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#include "assert.h"
+#include "tlb_perf.h"
+
+/*
+ * open_counter()
+ * Parameters: which TLB to count (PERF_COUNT_HW_CACHE_DTLB or _ITLB)
+ * Returns a disabled counter of read misses in that TLB, or -1
+ */
+static int open_counter(uint64_t cache)
+{
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size           = sizeof(attr);
+    attr.type           = PERF_TYPE_HW_CACHE;
+    attr.config         = cache
+                          | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+                          | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    attr.disabled       = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv     = 1;
+
+    return syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+/*
+ * start_counter()
+ * Parameters: a counter file descriptor (or -1)
+ * Resets and enables the counter
+ * Returns nothing
+ */
+static void start_counter(int fd)
+{
+    if (fd >= 0) {
+        ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+        ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+}
+
+/*
+ * report_counter()
+ * Parameters: stream to print to, label, a counter file descriptor (or -1)
+ * Stops the counter, prints its value, and closes it
+ * Returns nothing
+ */
+static void report_counter(FILE *out, const char *label, int fd)
+{
+    uint64_t count;
+    if (fd < 0) {
+        fprintf(out, "%s unavailable\n", label);
+        return;
+    }
+
+    ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+    if (read(fd, &count, sizeof(count)) == sizeof(count)) {
+        fprintf(out, "%s %llu\n", label, (unsigned long long)count);
+    } else {
+        fprintf(out, "%s unavailable\n", label);
+    }
+    close(fd);
+}
+
+/*
+ * tlb_start()
+ * Parameters: a tlb_counters pointer
+ * Opens and starts the dTLB and iTLB miss counters
+ * Returns nothing
+ */
+void tlb_start(tlb_counters *tlb)
+{
+    assert(tlb != NULL);
+    tlb->dtlb_fd = open_counter(PERF_COUNT_HW_CACHE_DTLB);
+    tlb->itlb_fd = open_counter(PERF_COUNT_HW_CACHE_ITLB);
+    start_counter(tlb->dtlb_fd);
+    start_counter(tlb->itlb_fd);
+}
+
+/*
+ * tlb_report()
+ * Parameters: a tlb_counters pointer, stream to print to
+ * Stops both counters and prints the number of misses counted
+ * Returns nothing
+ */
+void tlb_report(tlb_counters *tlb, FILE *out)
+{
+    assert(tlb != NULL && out != NULL);
+    report_counter(out, "dTLB misses:  ", tlb->dtlb_fd);
+    report_counter(out, "iTLB misses:  ", tlb->itlb_fd);
+}
@@ -0,0 +1,23 @@
+/*****************************************************************************
+ *
+ *    tlb_perf.h
+ *
+ *    Header file for tlb_perf module, which counts dTLB and iTLB misses
+ *    with perf_event_open
+ *
+ *****************************************************************************/
+#ifndef TLB_PERF_H
+#define TLB_PERF_H
+
+#include <stdio.h>
+
+typedef struct tlb_counters {
+    int dtlb_fd;
+    int itlb_fd;
+} tlb_counters;
+
+/* Functions to start counting and to stop and print the counts */
+void tlb_start (tlb_counters *tlb);
+void tlb_report(tlb_counters *tlb, FILE *out);
+
+#endif
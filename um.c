@@ -5,23 +5,24 @@
  *    By:   Sitara Rao (srao03) and Arnav Kothari (akotha02)
  *    Date: 11/20/2019
  *      
- *    Main driver for the universal machine (um) program. Defines the main()
- *    function as well as um_new(), um_run(), and um_free().
+ *    Implementation of the universal machine (um). Defines um_new(),
+ *    um_step(), um_run(), and um_free().
  *    Relies on 3 modules:
  *          - seg_mem for accessing/modifying memory
  *          - instructions for handling 13 of the 14 defined um instructions
- *          - bitpack for unpacking 
+ *          - bits for unpacking
  *
  *****************************************************************************/
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <inttypes.h>
+#include <unistd.h>
 
 #include "um.h"
 #include "instructions.h"
 #include "seg_mem.h"
-#include "bitpack.h"
+#include "bits.h"
 #include "assert.h"
 
 typedef uint32_t Um_instruction;
@@ -50,43 +51,38 @@ static const unsigned VAL_LSB   = 0;
  *                    UM Functions                    *
  ******************************************************/
 /*
- * main()
- * Takes in the name of one um program file on the command line.
- * If filename is not provided or file does not exist it is a CRE.
- * Calls functions to initialize, run, and free a um object.
- * Returns 0. 
+ * um_new()
+ * Takes in a FILE pointer to the file containing the um program to be run.
+ * Creates a um that reads from stdin and writes to stdout (see um_new_io).
+ * Returns a pointer to the newly created um object.
  */
-int main(int argc, char* argv[])
+um_obj* um_new(FILE* fp)
 {
-    assert(argc == 2);
-    FILE* fp = fopen(argv[1], "r");
-    assert(fp != NULL);
-
-    um_obj *um = um_new(fp);
-    um_run(um);
-    um_free(um);
-
-    fclose(fp);
-    return 0;
+    return um_new_io(fp, STDIN_FILENO, stdout);
 }
 
 /*
- * um_new()
- * Takes in a FILE pointer to the file containing the um program to be run.
+ * um_new_io()
+ * Takes in a FILE pointer to the file containing the um program to be run,
+ * a file descriptor for the um's input and a FILE pointer for its output.
  * Allocates memory for a um object.
  * Sets program_counter and all registers to 0.
  * Calls init_prog() to read instructions from the program file into m[0].
  * Returns a pointer to the newly created um object.
  */
-um_obj* um_new(FILE* fp)
+um_obj* um_new_io(FILE* fp, int in_fd, FILE *out)
 {
     um_obj *new_um = malloc(sizeof(um_obj));
+    assert(new_um != NULL);
     new_um->memory = seg_mem_new();
 
     new_um->program_counter = 0;
     for (int i = 0; i < 8; i++) {
         new_um->registers[i] = 0;
     }
+    new_um->status   = UM_RUNNING;
+    new_um->executed = 0;
+    io_init(&new_um->io, in_fd, out);
 
     /* Load contents of um program into m[0] */
     init_prog(new_um->memory, fp);
@@ -95,26 +91,41 @@ um_obj* um_new(FILE* fp)
 }
 
 /*
- * um_run()
- * Takes in a pointer to an initialized um object.
+ * um_step()
+ * Takes in a pointer to an initialized um object and the maximum number of
+ * instructions to execute.
  * Iterates through instructions in m[0], using program counter.
  * Unpacks values in each instruction and then executes by calling the
  * appropriate function from instructions module.
- * Returns nothing when computation has finished (either reached end of
- * m[0] or encoutered a "halt" instruction).
+ * Stops early, without executing it, when the next instruction is "in"
+ * and no input is available yet; calling um_step() again resumes there.
+ * Returns UM_HALTED once computation has finished (either reached end of
+ * m[0] or encoutered a "halt" instruction), UM_BLOCKED if stopped on "in",
+ * and UM_RUNNING if the budget ran out. The status is also saved in um.
  */
-void um_run(um_obj *um)
+um_status um_step(um_obj *um, uint32_t budget)
 {
-    while (um->program_counter < program_size(um->memory)) {
+    if (um->status == UM_HALTED) {
+        return UM_HALTED;
+    }
+
+    um_status status = UM_RUNNING;
+    uint32_t executed = 0;
+
+    while (executed < budget) {
+        if (um->program_counter >= program_size(um->memory)) {
+            status = UM_HALTED;
+            break;
+        }
 
         uint32_t curr_instr = get_prog_instruction(um->memory, 
                                                    um->program_counter);
-        Um_opcode opcode = Bitpack_getu(curr_instr, OP_WIDTH, OP_LSB);
+        Um_opcode opcode = bits_getu(curr_instr, OP_WIDTH, OP_LSB);
 
         /* Used by opcodes 0-12 */
-        uint32_t reg_a = Bitpack_getu(curr_instr, REG_WIDTH, RA_LSB);
-        uint32_t reg_b = Bitpack_getu(curr_instr, REG_WIDTH, RB_LSB);
-        uint32_t reg_c = Bitpack_getu(curr_instr, REG_WIDTH, RC_LSB);
+        uint32_t reg_a = bits_getu(curr_instr, REG_WIDTH, RA_LSB);
+        uint32_t reg_b = bits_getu(curr_instr, REG_WIDTH, RB_LSB);
+        uint32_t reg_c = bits_getu(curr_instr, REG_WIDTH, RC_LSB);
 
         /* Used only by opcode 13 */
         uint32_t val;
@@ -149,7 +160,8 @@ void um_run(um_obj *um)
                     bitwise_nand(um->registers, reg_a, reg_b, reg_c);
                     break;
             case HALT:
-                    return;
+                    status = UM_HALTED;
+                    break;
             case ACTIVATE:
                     map_segment(um->registers, um->memory, reg_b, reg_c);
                     break;
@@ -157,10 +169,14 @@ void um_run(um_obj *um)
                     unmap_segment(um->registers, um->memory, reg_c);
                     break;
             case OUT:
-                    output(um->registers, reg_c);
+                    output(um->registers, &um->io, reg_c);
                     break;
             case IN: 
-                    input(um->registers, reg_c);
+                    /* Leave program counter on "in" so we retry it later */
+                    if (!input_ready(&um->io)
+                        || !input(um->registers, &um->io, reg_c)) {
+                        status = UM_BLOCKED;
+                    }
                     break;
             case LOADP:
                     um->program_counter = load_program(um->registers,
@@ -168,8 +184,8 @@ void um_run(um_obj *um)
                                                                    reg_c);
                     break;
             case LV: 
-                    reg_a = Bitpack_getu(curr_instr, REG_WIDTH, RA_LV_LSB);
-                    val   = Bitpack_getu(curr_instr, VAL_WIDTH, VAL_LSB);
+                    reg_a = bits_getu(curr_instr, REG_WIDTH, RA_LV_LSB);
+                    val   = bits_getu(curr_instr, VAL_WIDTH, VAL_LSB);
                     load_value(um->registers, reg_a, val);
                     break;
             default:
@@ -177,8 +193,35 @@ void um_run(um_obj *um)
                     break;
         }
 
+        if (status != UM_RUNNING) {
+            break;
+        }
+
         /* Increment program counter to get next instruction */
         um->program_counter++;                  
+        executed++;
+    }
+
+    um->executed += executed;
+    um->status = status;
+    return status;
+}
+
+/*
+ * um_run()
+ * Takes in a pointer to an initialized um object.
+ * Calls um_step() until the um halts, waiting for input whenever the
+ * um stops on an "in" instruction. Output is flushed before waiting so
+ * that prompts reach the user before the um blocks.
+ * Returns nothing when computation has finished.
+ */
+void um_run(um_obj *um)
+{
+    while (um_step(um, UINT32_MAX) != UM_HALTED) {
+        if (um->status == UM_BLOCKED) {
+            fflush(um->io.out);
+            input_wait(&um->io);
+        }
     }
 }
 
@@ -192,4 +235,4 @@ void um_free(um_obj* um)
 {    
     seg_mem_free(um->memory);
     free(um);
-}
\ No newline at end of file
+}
@@ -11,13 +11,25 @@
 #ifndef UM_H
 #define UM_H
 
+#include <stdio.h>
 #include "seg_mem.h"
+#include "instructions.h"
+
+/* Result of running a um for a bounded number of instructions */
+typedef enum um_status {
+        UM_RUNNING = 0,     /* budget used up, more instructions to run */
+        UM_HALTED,          /* halted or ran off the end of m[0]        */
+        UM_BLOCKED          /* next instruction is "in" and would block */
+} um_status;
 
 /* um struct declaration */
 typedef struct um_obj {
     seg_mem_obj *memory;
     uint32_t registers[8];
     uint32_t program_counter;
+    um_status status;
+    uint64_t executed;
+    um_io io;
 } um_obj;
 
 /* um functions called by main() */
@@ -25,4 +37,8 @@ um_obj* um_new(FILE* ptr);
 void um_run(um_obj *um);
 void um_free(um_obj* um);
 
-#endif
\ No newline at end of file
+/* Functions for running a um in slices (used by the scheduler) */
+um_obj*   um_new_io(FILE* ptr, int in_fd, FILE *out);
+um_status um_step(um_obj *um, uint32_t budget);
+
+#endif
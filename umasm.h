@@ -0,0 +1,55 @@
+/*****************************************************************************
+ *
+ *    umasm.h
+ *
+ *    Inline helpers for writing um programs from C, shared by the program
+ *    generators (mktrain, mkcold) and umbench's built-in session program:
+ *    the opcodes, encoders for the two instruction formats, and a writer
+ *    for the big-endian words of a .um file.
+ *
+ *****************************************************************************/
+#ifndef UMASM_H
+#define UMASM_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+enum { CMOV = 0, SLOAD, SSTORE, ADD, MUL, DIV,
+       NAND, HALT, ACTIVATE, INACTIVATE, OUT, IN, LOADP, LV };
+
+/*
+ * op()
+ * Parameters: an opcode other than LV, registers a, b and c
+ * Returns the three-register instruction
+ */
+static inline uint32_t op(unsigned opcode, unsigned a, unsigned b, unsigned c)
+{
+    return (uint32_t)opcode << 28 | a << 6 | b << 3 | c;
+}
+
+/*
+ * lv()
+ * Parameters: register a, a value that fits in 25 bits
+ * Returns the load value instruction
+ */
+static inline uint32_t lv(unsigned a, uint32_t value)
+{
+    return (uint32_t)LV << 28 | a << 25 | value;
+}
+
+/*
+ * emit()
+ * Parameters: stream to write to, an instruction
+ * Writes the instruction in big-endian order
+ * Returns the number of instructions emit() has written so far
+ */
+static inline uint32_t emit(FILE *out, uint32_t word)
+{
+    static uint32_t emitted = 0;
+    for (int i = 3; i >= 0; i--) {
+        putc((word >> (i * 8)) & 0xff, out);
+    }
+    return ++emitted;
+}
+
+#endif
@@ -0,0 +1,366 @@
+/*****************************************************************************
+ *
+ *    umbench.c
+ *
+ *    Scaling benchmark for the sched module. Runs N ums twice: once
+ *    time-sliced over a fixed pool of worker threads with sched_run(), and
+ *    once with one OS thread per um calling um_run() (the baseline).
+ *
+ *    Usage: umbench program.um n_ums [workers [quantum]]
+ *           umbench -p rounds n_ums [workers [quantum]]
+ *
+ *    In the first form every um runs program.um, reading from and writing
+ *    to /dev/null, so it never waits for input.
+ *
+ *    With -p every um runs a built-in interactive session program that
+ *    reads a byte, does SESSION_WORK iterations of arithmetic, and echoes
+ *    the byte back, until end of input. Each um talks to a feeder thread
+ *    over its own pair of pipes. In each of the given number of rounds
+ *    the feeder sends one byte to every um, then waits for every reply.
+ *    So between rounds all ums are blocked on "in", which exercises the
+ *    scheduler's waiting list and poller.
+ *
+ *****************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+
+#include "assert.h"
+#include "um.h"
+#include "sched.h"
+#include "umasm.h"
+
+/* Defaults for optional command line arguments */
+static const unsigned DEFAULT_QUANTUM = 10000;
+
+/* Stack size for baseline threads; um_run() needs very little */
+static const size_t BASELINE_STACK = 64 * 1024;
+
+/* Loop iterations the session program runs for each input byte */
+static const uint32_t SESSION_WORK = 1000;
+
+/* Label addresses in the session program */
+enum { SESSION_HALT = 7, SESSION_WORK_START = 8, SESSION_LOOP = 10,
+       SESSION_REPLY = 18, SESSION_LEN = 21 };
+
+/* One um's pipes in -p mode */
+typedef struct session {
+    int to_um;          /* feeder writes input here */
+    int from_um;        /* feeder reads replies here */
+    int um_in;          /* the um's input descriptor */
+    FILE *um_out;       /* the um's output stream */
+} session;
+
+/* Arguments for the feeder thread */
+typedef struct feeder_args {
+    session *sessions;
+    unsigned n;
+    unsigned rounds;
+} feeder_args;
+
+/*
+ * now()
+ * Returns the current monotonic time in seconds
+ */
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**************************************************************************
+*                          Built-in session program                       *
+***************************************************************************/
+/*
+ * session_program()
+ * Returns a FILE reading the session program from memory
+ */
+static FILE *session_program(void)
+{
+    static unsigned char bytes[SESSION_LEN * 4];
+    uint32_t words[SESSION_LEN] = {
+        op(IN, 0, 0, 1),                   /*  0: r1 = input             */
+        op(NAND, 2, 1, 1),                 /*  1: r2 = 0 iff end of input */
+        lv(5, SESSION_HALT),               /*  2                          */
+        lv(6, SESSION_WORK_START),         /*  3                          */
+        op(CMOV, 5, 6, 2),                 /*  4: r5 = r2 ? work : halt   */
+        lv(0, 0),                          /*  5                          */
+        op(LOADP, 0, 0, 5),                /*  6                          */
+        op(HALT, 0, 0, 0),                 /*  7                          */
+        lv(3, SESSION_WORK),               /*  8: r3 = loop counter       */
+        op(NAND, 7, 0, 0),                 /*  9: r7 = -1 (r0 is 0)       */
+        op(ADD, 3, 3, 7),                  /* 10: loop: r3--              */
+        op(MUL, 4, 3, 3),                  /* 11                          */
+        op(ADD, 4, 4, 1),                  /* 12                          */
+        lv(5, SESSION_REPLY),              /* 13                          */
+        lv(6, SESSION_LOOP),               /* 14                          */
+        op(CMOV, 5, 6, 3),                 /* 15: r5 = r3 ? loop : reply  */
+        lv(0, 0),                          /* 16                          */
+        op(LOADP, 0, 0, 5),                /* 17                          */
+        op(OUT, 0, 0, 1),                  /* 18: reply: echo the byte    */
+        lv(5, 0),                          /* 19                          */
+        op(LOADP, 0, 5, 5),                /* 20: back to 0               */
+    };
+
+    FILE *fp = fmemopen(bytes, sizeof(bytes), "w+");
+    assert(fp != NULL);
+    for (unsigned i = 0; i < SESSION_LEN; i++) {
+        emit(fp, words[i]);
+    }
+    rewind(fp);
+    return fp;
+}
+
+/**************************************************************************
+*                         Creating and freeing ums                        *
+***************************************************************************/
+/*
+ * open_sessions()
+ * Parameters: number of ums
+ * Returns a newly allocated array of n sessions, each with fresh pipes
+ */
+static session *open_sessions(unsigned n)
+{
+    session *sessions = malloc(n * sizeof(*sessions));
+    assert(sessions != NULL);
+    for (unsigned i = 0; i < n; i++) {
+        int in_pipe[2], out_pipe[2];
+        int result = pipe(in_pipe);
+        assert(result == 0);
+        result = pipe(out_pipe);
+        assert(result == 0);
+
+        sessions[i].um_in   = in_pipe[0];
+        sessions[i].to_um   = in_pipe[1];
+        sessions[i].from_um = out_pipe[0];
+        sessions[i].um_out  = fdopen(out_pipe[1], "w");
+        assert(sessions[i].um_out != NULL);
+    }
+    return sessions;
+}
+
+/*
+ * close_sessions()
+ * Parameters: array of n sessions whose feeder has finished
+ * Closes the remaining pipe ends and frees the array
+ */
+static void close_sessions(session *sessions, unsigned n)
+{
+    for (unsigned i = 0; i < n; i++) {
+        close(sessions[i].um_in);
+        close(sessions[i].from_um);
+        fclose(sessions[i].um_out);
+    }
+    free(sessions);
+}
+
+/*
+ * load_ums()
+ * Parameters: program file name (NULL for the session program); number of
+ *             ums; sessions to use for I/O (NULL for /dev/null streams)
+ * Returns a newly allocated array of n ums, each loaded with the program
+ */
+static um_obj **load_ums(char *path, unsigned n, session *sessions,
+                         int null_fd, FILE *null_out)
+{
+    um_obj **ums = malloc(n * sizeof(*ums));
+    assert(ums != NULL);
+    for (unsigned i = 0; i < n; i++) {
+        FILE *fp = path != NULL ? fopen(path, "r") : session_program();
+        assert(fp != NULL);
+        if (sessions != NULL) {
+            ums[i] = um_new_io(fp, sessions[i].um_in, sessions[i].um_out);
+        } else {
+            ums[i] = um_new_io(fp, null_fd, null_out);
+        }
+        fclose(fp);
+    }
+    return ums;
+}
+
+/*
+ * free_ums()
+ * Parameters: array of n ums
+ * Returns the total number of instructions the ums executed, after
+ * freeing them and the array
+ */
+static uint64_t free_ums(um_obj **ums, unsigned n)
+{
+    uint64_t total = 0;
+    for (unsigned i = 0; i < n; i++) {
+        total += ums[i]->executed;
+        um_free(ums[i]);
+    }
+    free(ums);
+    return total;
+}
+
+/**************************************************************************
+*                              Running ums                                *
+***************************************************************************/
+/*
+ * run_thread()
+ * Parameters: a um (as a void pointer)
+ * Baseline thread body: runs the um to completion
+ * Returns NULL
+ */
+static void *run_thread(void *arg)
+{
+    um_run(arg);
+    return NULL;
+}
+
+/*
+ * feeder()
+ * Parameters: a feeder_args (as a void pointer)
+ * Sends one byte to every um and waits for every reply, once per round,
+ * then closes the ums' input so they halt
+ * Returns NULL
+ */
+static void *feeder(void *arg)
+{
+    feeder_args *args = arg;
+    for (unsigned r = 0; r < args->rounds; r++) {
+        char byte = 'a' + r % 26;
+        for (unsigned i = 0; i < args->n; i++) {
+            ssize_t nwritten = write(args->sessions[i].to_um, &byte, 1);
+            assert(nwritten == 1);
+        }
+        for (unsigned i = 0; i < args->n; i++) {
+            char reply;
+            ssize_t nread = read(args->sessions[i].from_um, &reply, 1);
+            assert(nread == 1 && reply == byte);
+        }
+    }
+    for (unsigned i = 0; i < args->n; i++) {
+        close(args->sessions[i].to_um);
+    }
+    return NULL;
+}
+
+/*
+ * run_ums()
+ * Parameters: array of n ums; workers and quantum for the scheduler, or
+ *             0 workers for the thread-per-um baseline
+ * Runs all ums to completion
+ */
+static void run_ums(um_obj **ums, unsigned n, unsigned workers,
+                    unsigned quantum)
+{
+    if (workers > 0) {
+        um_sched *sched = sched_new(workers, quantum);
+        for (unsigned i = 0; i < n; i++) {
+            sched_add(sched, ums[i], SCHED_UNLIMITED);
+        }
+        sched_run(sched);
+        sched_free(sched);
+        return;
+    }
+
+    pthread_t *threads = malloc(n * sizeof(*threads));
+    assert(threads != NULL);
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setstacksize(&attr, BASELINE_STACK);
+    for (unsigned i = 0; i < n; i++) {
+        int result = pthread_create(&threads[i], &attr, run_thread, ums[i]);
+        assert(result == 0);
+    }
+    for (unsigned i = 0; i < n; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    pthread_attr_destroy(&attr);
+    free(threads);
+}
+
+/*
+ * bench()
+ * Parameters: name of the mode; program file name (NULL for the session
+ *             program); number of ums; rounds (for the session program);
+ *             workers (0 for the baseline) and quantum
+ * Loads n ums, times running them all to completion, and prints results
+ * Returns nothing
+ */
+static void bench(const char *mode, char *path, unsigned n, unsigned rounds,
+                  unsigned workers, unsigned quantum)
+{
+    int null_fd = open("/dev/null", O_RDONLY);
+    FILE *null_out = fopen("/dev/null", "w");
+    assert(null_fd >= 0 && null_out != NULL);
+
+    session *sessions = path == NULL ? open_sessions(n) : NULL;
+    um_obj **ums = load_ums(path, n, sessions, null_fd, null_out);
+
+    pthread_t feed_thread;
+    feeder_args args = { sessions, n, rounds };
+    double start = now();
+    if (sessions != NULL) {
+        int result = pthread_create(&feed_thread, NULL, feeder, &args);
+        assert(result == 0);
+    }
+    run_ums(ums, n, workers, quantum);
+    if (sessions != NULL) {
+        pthread_join(feed_thread, NULL);
+    }
+    double secs = now() - start;
+
+    uint64_t instrs = free_ums(ums, n);
+    printf("%-10s %8u ums %10.3f s %14" PRIu64 " instrs %10.1f Minstr/s",
+           mode, n, secs, instrs, instrs / secs / 1e6);
+    if (sessions != NULL) {
+        printf(" %10.0f replies/s", (double)n * rounds / secs);
+        close_sessions(sessions, n);
+    }
+    printf("\n");
+
+    fclose(null_out);
+    close(null_fd);
+}
+
+int main(int argc, char *argv[])
+{
+    unsigned rounds = 0;
+    int opt;
+    while ((opt = getopt(argc, argv, "p")) != -1) {
+        assert(opt == 'p');
+        rounds = 1;
+    }
+    int nargs = argc - optind;
+    assert(nargs >= 2 && nargs <= 4);
+    char **args = argv + optind;
+
+    char *path = NULL;
+    if (rounds > 0) {
+        rounds = strtoul(args[0], NULL, 10);
+    } else {
+        path = args[0];
+    }
+    unsigned n       = strtoul(args[1], NULL, 10);
+    long     ncpus   = sysconf(_SC_NPROCESSORS_ONLN);
+    unsigned workers = nargs > 2 ? strtoul(args[2], NULL, 10)
+                                 : (unsigned)(ncpus > 0 ? ncpus : 1);
+    unsigned quantum = nargs > 3 ? strtoul(args[3], NULL, 10)
+                                 : DEFAULT_QUANTUM;
+    assert(n > 0 && workers > 0 && quantum > 0);
+    assert(path != NULL || rounds > 0);
+
+    /* Sessions need four descriptors per um */
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0) {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+
+    bench("sched", path, n, rounds, workers, quantum);
+    bench("thread/um", path, n, rounds, 0, quantum);
+    printf("(%u workers, quantum %u)\n", workers, quantum);
+
+    return 0;
+}